@@ -1,4 +1,5 @@
 #include "image.h"
+#include "raster.h"
 
 namespace
 {
@@ -82,9 +83,8 @@ namespace
 		return result;
 	}
 
-	std::vector<Point_t> readPoints (const std::string& filename)
+	std::vector<Point_t> readPoints (std::istream& istr)
 	{
-		std::ifstream istr (filename);
 		int count = 0;
 		istr >> count;
 		std::vector<Point_t> pts;
@@ -113,17 +113,36 @@ namespace
 		throw std::runtime_error ("intersection not found");
 	}
 
-	void printPoints (const std::vector<Point_t>& pts, const std::string& filename)
+	void printPoints (const std::vector<Point_t>& pts, const Point_t& offset, const std::string& filename)
 	{
 		std::ofstream ostr (filename);
 		for (const auto& pt : pts)
-			ostr << pt.x () << " " << pt.y () << "\n";
+			ostr << pt.x () + offset.x () << " " << pt.y () + offset.y () << "\n";
 	}
 }
 
+std::vector<Point_t> LoadPoints (std::istream& istr, const std::string& name)
+{
+	return IsRasterFile (name) ?
+			ReadRasterContour (istr, name) :
+			readPoints (istr);
+}
+
+std::vector<Point_t> LoadPoints (const std::string& filename)
+{
+	std::ifstream istr (filename, std::ios::binary);
+	return LoadPoints (istr, filename);
+}
+
 Image::Image (const std::string& filename)
+: Image (filename, LoadPoints (filename))
+{
+}
+
+Image::Image (const std::string& filename, std::vector<Point_t> points)
 : Filename_ (filename)
-, SourcePoints_ (readPoints (filename))
+, SourcePoints_ (std::move (points))
+, Offset_ (0, 0)
 {
 	bp::construct_voronoi (SourcePoints_.begin (), SourcePoints_.end (), &SourceVD_);
 
@@ -134,31 +153,81 @@ Image::Image (const std::string& filename)
 	BuildSkeleton ();
 }
 
+Image::Image (const std::string& filename, std::vector<Point_t> points, const Image_ptr& original, const Point_t& offset)
+: Filename_ (filename)
+, SourcePoints_ (std::move (points))
+, Original_ (original)
+, Offset_ (offset)
+{
+}
+
+bool Image::IsDuplicate () const
+{
+	return static_cast<bool> (Original_);
+}
+
 void Image::PrintPseudoHull () const
 {
-	printPoints (PseudoHull_, Filename_ + ".hull");
+	printPoints (Geometry ().PseudoHull_, Offset_, Filename_ + ".hull");
 }
 
-void Image::PrintSkeleton () const
+void Image::PrintSkeleton (SkeletonFilter filter) const
 {
+	const auto dx = Offset_.x (), dy = Offset_.y ();
+
 	std::ofstream ostr (Filename_ + ".skel");
-	for (const auto& edge : SkeletonVD_.edges ())
+	for (const auto& edge : CollectSkeleton (filter))
+		ostr << edge.first.first + dx << " " << edge.first.second + dy << "\n"
+				<< edge.second.first + dx << " " << edge.second.second + dy << "\n";
+}
+
+void Image::PrintSkeletonGraph (SkeletonFilter filter, double minSpurLength) const
+{
+	SkeletonGraph graph (CollectSkeleton (filter));
+	graph.PruneSpurs (minSpurLength);
+
+	std::ofstream ostr (Filename_ + ".skelg", std::ios::binary);
+	graph.Write (ostr, Offset_.x (), Offset_.y ());
+}
+
+std::vector<SkeletonGraph::Edge_t> Image::CollectSkeleton (SkeletonFilter filter) const
+{
+	const auto& geom = Geometry ();
+
+	std::vector<bool> interior;
+	if (filter == SkeletonFilter::Topological)
+		interior = geom.ClassifyInteriorEdges ();
+
+	std::vector<SkeletonGraph::Edge_t> result;
+	const auto& edges = geom.SkeletonVD_.edges ();
+	for (size_t i = 0; i < edges.size (); ++i)
 	{
+		const auto& edge = edges [i];
 		if (!edge.is_finite () || !edge.is_primary ())
 			continue;
 
 		const auto& v0 = *edge.vertex0 (), v1 = *edge.vertex1 ();
-		const Segment_t edgeSeg ({ v0.x (), v0.y () }, { v1.x (), v1.y () });
 
-		if (std::any_of (PseudoHullSegs_.begin (), PseudoHullSegs_.end (),
-				[&edgeSeg] (const Segment_t& seg)
-				{
-					return bp::intersects (seg, edgeSeg);
-				}))
-			continue;
+		if (filter == SkeletonFilter::Topological)
+		{
+			if (!interior [i])
+				continue;
+		}
+		else
+		{
+			const Segment_t edgeSeg ({ v0.x (), v0.y () }, { v1.x (), v1.y () });
+
+			if (std::any_of (geom.PseudoHullSegs_.begin (), geom.PseudoHullSegs_.end (),
+					[&edgeSeg] (const Segment_t& seg)
+					{
+						return bp::intersects (seg, edgeSeg);
+					}))
+				continue;
+		}
 
-		ostr << edge.vertex0 ()->x () << " " << edge.vertex0 ()->y () << "\n" << edge.vertex1 ()->x () << " " << edge.vertex1 ()->y () << "\n";
+		result.push_back ({ { v0.x (), v0.y () }, { v1.x (), v1.y () } });
 	}
+	return result;
 }
 
 void Image::BuildReachableMap ()
@@ -244,3 +313,124 @@ void Image::BuildSkeleton ()
 {
 	bp::construct_voronoi (PseudoHullSegs_.begin (), PseudoHullSegs_.end (), &SkeletonVD_);
 }
+
+const Image& Image::Geometry () const
+{
+	return Original_ ? *Original_ : *this;
+}
+
+/* Labels the primary finite edges lying strictly inside the pseudo hull,
+ * without touching it, indexed as SkeletonVD_.edges ().
+ *
+ * A segment cell surrounds its segment, so the side of an edge of such a
+ * cell is given by the orientation of the segment alone. Those edges seed
+ * a flood fill over primary edges, which reaches the edges between point
+ * cells at reflex corners. The fill never passes through a vertex lying on
+ * a hull vertex, since that's the only place where interior and exterior
+ * primary edges meet for a simple polygon.
+ */
+std::vector<bool> Image::ClassifyInteriorEdges () const
+{
+	typedef bp::voronoi_diagram<double> VD_t;
+
+	const auto& edges = SkeletonVD_.edges ();
+	const auto& vertices = SkeletonVD_.vertices ();
+
+	double area = 0;
+	for (const auto& seg : PseudoHullSegs_)
+		area += absVec (seg.low (), seg.high ());
+	const auto orientation = area >= 0 ? 1 : -1;
+
+	auto edgeIdx = [&edges] (const VD_t::edge_type *e) { return e - &edges.front (); };
+	auto vertexIdx = [&vertices] (const VD_t::vertex_type *v) { return v - &vertices.front (); };
+
+	auto sitePoint = [this] (const VD_t::cell_type *cell)
+	{
+		const auto& seg = PseudoHullSegs_ [cell->source_index ()];
+		return cell->source_category () == bp::SOURCE_CATEGORY_SEGMENT_START_POINT ?
+				seg.low () :
+				seg.high ();
+	};
+
+	auto isBoundary = [&sitePoint] (const VD_t::vertex_type& v)
+	{
+		auto e = v.incident_edge ();
+		do
+		{
+			if (e->cell ()->contains_point ())
+			{
+				const auto& pt = sitePoint (e->cell ());
+				if (pt.x () == v.x () && pt.y () == v.y ())
+					return true;
+			}
+			e = e->rot_next ();
+		}
+		while (e != v.incident_edge ());
+		return false;
+	};
+
+	// 0 is unvisited, 1 is a hull vertex, 2 is an interior vertex.
+	std::vector<char> vertexState (vertices.size (), 0);
+	std::vector<const VD_t::vertex_type*> stack;
+
+	std::vector<bool> interior (edges.size (), false);
+	auto markEdge = [&] (const VD_t::edge_type *e)
+	{
+		interior [edgeIdx (e)] = true;
+		interior [edgeIdx (e->twin ())] = true;
+
+		for (auto v : { e->vertex0 (), e->vertex1 () })
+		{
+			auto& state = vertexState [vertexIdx (v)];
+			if (state)
+				continue;
+
+			state = isBoundary (*v) ? 1 : 2;
+			if (state == 2)
+				stack.push_back (v);
+		}
+	};
+
+	for (const auto& edge : edges)
+	{
+		if (!edge.is_finite () || !edge.is_primary () ||
+				!edge.cell ()->contains_segment () || interior [edgeIdx (&edge)])
+			continue;
+
+		const auto& seg = PseudoHullSegs_ [edge.cell ()->source_index ()];
+		const auto mx = (edge.vertex0 ()->x () + edge.vertex1 ()->x ()) / 2;
+		const auto my = (edge.vertex0 ()->y () + edge.vertex1 ()->y ()) / 2;
+		const double sx = seg.high ().x () - seg.low ().x ();
+		const double sy = seg.high ().y () - seg.low ().y ();
+		const auto side = sx * (my - seg.low ().y ()) - sy * (mx - seg.low ().x ());
+		if (side * orientation > 0)
+			markEdge (&edge);
+	}
+
+	while (!stack.empty ())
+	{
+		const auto v = stack.back ();
+		stack.pop_back ();
+
+		auto e = v->incident_edge ();
+		do
+		{
+			if (e->is_finite () && e->is_primary () && !interior [edgeIdx (e)])
+				markEdge (e);
+			e = e->rot_next ();
+		}
+		while (e != v->incident_edge ());
+	}
+
+	// Edges touching the hull aren't a part of the skeleton.
+	for (size_t i = 0; i < edges.size (); ++i)
+		if (interior [i])
+		{
+			const auto& edge = edges [i];
+			if (vertexState [vertexIdx (edge.vertex0 ())] == 1 ||
+					vertexState [vertexIdx (edge.vertex1 ())] == 1)
+				interior [i] = false;
+		}
+
+	return interior;
+}
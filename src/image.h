@@ -7,17 +7,32 @@
 #include <stdexcept>
 #include <memory>
 #include <boost/polygon/voronoi.hpp>
+#include "skeletongraph.h"
 
 namespace bp = boost::polygon;
 
 typedef bp::point_data<int> Point_t;
 typedef bp::segment_data<Point_t::coordinate_type> Segment_t;
 
+enum class SkeletonFilter
+{
+	Geometric,
+	Topological
+};
+
+class Image;
+typedef std::shared_ptr<Image> Image_ptr;
+
 class Image
 {
 	const std::string Filename_;
 	const std::vector<Point_t> SourcePoints_;
 
+	// Set for duplicates of an already processed shape: the geometry is
+	// taken from Original_ and shifted by Offset_ on output.
+	const std::shared_ptr<const Image> Original_;
+	const Point_t Offset_;
+
 	bp::voronoi_diagram<double> SourceVD_;
 
 public:
@@ -33,9 +48,14 @@ private:
 	bp::voronoi_diagram<double> SkeletonVD_;
 public:
 	Image (const std::string&);
+	Image (const std::string&, std::vector<Point_t>);
+	Image (const std::string&, std::vector<Point_t>, const Image_ptr& original, const Point_t& offset);
+
+	bool IsDuplicate () const;
 
 	void PrintPseudoHull () const;
-	void PrintSkeleton () const;
+	void PrintSkeleton (SkeletonFilter = SkeletonFilter::Geometric) const;
+	void PrintSkeletonGraph (SkeletonFilter, double minSpurLength) const;
 private:
 	void BuildReachableMap ();
 
@@ -44,6 +64,12 @@ private:
 	void BuildPseudoHullSegs ();
 
 	void BuildSkeleton ();
+
+	std::vector<bool> ClassifyInteriorEdges () const;
+	std::vector<SkeletonGraph::Edge_t> CollectSkeleton (SkeletonFilter) const;
+
+	const Image& Geometry () const;
 };
 
-typedef std::shared_ptr<Image> Image_ptr;
+std::vector<Point_t> LoadPoints (const std::string& filename);
+std::vector<Point_t> LoadPoints (std::istream& istr, const std::string& name);
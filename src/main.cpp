@@ -1,5 +1,8 @@
 #include "image.h"
+#include "shapecache.h"
+#include "tarreader.h"
 #include <future>
+#include <sstream>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
@@ -17,42 +20,209 @@ struct LearnInfo
 	ImgType Type_;
 };
 
-int main (int argc, char **argv)
+namespace
 {
-	auto current = fs::current_path ();
-	current /= "data";
-
-	std::vector<fs::directory_entry> entries;
-	std::copy (fs::directory_iterator (current), fs::directory_iterator (), std::back_inserter (entries));
+	SkeletonFilter skeletonFilter = SkeletonFilter::Geometric;
 
-	std::vector<LearnInfo> learnData;
-	learnData.reserve (entries.size ());
+	// Negative unless the compact graph output has been requested.
+	double minSpurLength = -1;
 
-#pragma omp parallel for schedule (dynamic, 6)
-	for (size_t i = 0; i < entries.size (); ++i)
+	bool isSupported (const fs::path& path)
 	{
-		const auto entry = entries [i];
-
-		const auto path = entry.path ();
-		if (path.extension () != ".txt")
-			continue;
+		const auto ext = path.extension ();
+		return ext == ".txt" || ext == ".pbm" || ext == ".pgm";
+	}
 
+	bool getType (const fs::path& path, ImgType& type)
+	{
 		const auto leafStr = path.leaf ().string ();
-		ImgType type = ImgType::Bird;
 		if (leafStr.find ("п") == 0)
 			type = ImgType::Bird;
 		else if (leafStr.find ("р") == 0)
 			type = ImgType::Fish;
 		else
-			continue;
+			return false;
+		return true;
+	}
 
-		const auto str = path.string ();
-		Image_ptr img (new Image (str));
+	void process (const Image_ptr& img, ImgType type, std::vector<LearnInfo>& learnData)
+	{
 		img->PrintPseudoHull ();
-		img->PrintSkeleton ();
+		if (minSpurLength >= 0)
+			img->PrintSkeletonGraph (skeletonFilter, minSpurLength);
+		else
+			img->PrintSkeleton (skeletonFilter);
 #pragma omp critical
 		{
 			learnData.push_back ({ img, type });
 		}
 	}
+
+	void reportSkipped (const std::string& name, const std::exception& e)
+	{
+#pragma omp critical (report)
+		std::cerr << "skipping " << name << ": " << e.what () << std::endl;
+	}
+
+	void learnDirectory (const fs::path& dir, ShapeCache& cache, std::vector<LearnInfo>& learnData)
+	{
+		std::vector<fs::directory_entry> entries;
+		std::copy (fs::directory_iterator (dir), fs::directory_iterator (), std::back_inserter (entries));
+
+		learnData.reserve (entries.size ());
+
+#pragma omp parallel for schedule (dynamic, 6)
+		for (size_t i = 0; i < entries.size (); ++i)
+		{
+			const auto entry = entries [i];
+
+			const auto path = entry.path ();
+			if (!isSupported (path))
+				continue;
+
+			ImgType type = ImgType::Bird;
+			if (!getType (path, type))
+				continue;
+
+			const auto str = path.string ();
+			try
+			{
+				const auto img = cache.Get (str, LoadPoints (str));
+				process (img, type, learnData);
+			}
+			catch (const std::exception& e)
+			{
+				reportSkipped (str, e);
+			}
+		}
+	}
+
+	/* Entry names that would escape the output directory are rejected,
+	 * everything else is kept relative to it.
+	 */
+	bool getEntryPath (const fs::path& name, fs::path& rel)
+	{
+		rel.clear ();
+		for (const auto& part : name.relative_path ())
+		{
+			if (part == "..")
+				return false;
+			if (part != ".")
+				rel /= part;
+		}
+		return !rel.empty ();
+	}
+
+	/* Entries are read sequentially by a single thread and parsed by the
+	 * rest of the team as OpenMP tasks. Outputs are written next to the
+	 * archive, keeping the entry's directory inside the archive so that
+	 * entries sharing a file name do not overwrite each other.
+	 */
+	void learnArchive (const fs::path& archive, ShapeCache& cache, std::vector<LearnInfo>& learnData)
+	{
+		TarReader reader (archive.string ());
+		const auto outDir = archive.parent_path ();
+
+#pragma omp parallel
+#pragma omp single
+		{
+			try
+			{
+				TarReader::Entry entry;
+				while (reader.Next (entry))
+				{
+					const fs::path path (entry.Name_);
+					if (!isSupported (path))
+						continue;
+
+					ImgType type = ImgType::Bird;
+					if (!getType (path, type))
+						continue;
+
+					fs::path rel;
+					if (!getEntryPath (path, rel))
+					{
+						reportSkipped (entry.Name_, std::runtime_error ("path outside of the archive"));
+						continue;
+					}
+
+					const auto out = outDir / rel;
+					try
+					{
+						fs::create_directories (out.parent_path ());
+					}
+					catch (const std::exception& e)
+					{
+						reportSkipped (entry.Name_, e);
+						continue;
+					}
+
+					const auto name = out.string ();
+					auto data = std::make_shared<std::string> ();
+					data->swap (entry.Data_);
+#pragma omp task firstprivate (name, data, type) shared (cache)
+					{
+						try
+						{
+							std::istringstream istr (*data);
+							const auto img = cache.Get (name, LoadPoints (istr, name));
+							process (img, type, learnData);
+						}
+						catch (const std::exception& e)
+						{
+							reportSkipped (name, e);
+						}
+					}
+				}
+			}
+			catch (const std::exception& e)
+			{
+				// A damaged archive stops the reading, the entries
+				// already queued are still processed.
+				reportSkipped (archive.string (), e);
+			}
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	std::vector<LearnInfo> learnData;
+	ShapeCache cache;
+
+	std::string archive;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg (argv [i]);
+		if (arg == "--topological")
+			skeletonFilter = SkeletonFilter::Topological;
+		else if (arg == "--graph")
+			minSpurLength = 10;
+		else if (arg.compare (0, 8, "--graph=") == 0)
+			minSpurLength = std::stod (arg.substr (8));
+		else
+			archive = arg;
+	}
+
+	// Damaged images and entries are skipped, but an input that cannot be
+	// opened at all ends the run.
+	try
+	{
+		if (!archive.empty ())
+			learnArchive (archive, cache, learnData);
+		else
+		{
+			auto current = fs::current_path ();
+			current /= "data";
+			learnDirectory (current, cache, learnData);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "error: " << e.what () << std::endl;
+		return 1;
+	}
+
+	std::cout << "deduplicated " << cache.GetDeduplicated ()
+			<< " of " << cache.GetTotal () << " images" << std::endl;
 }
@@ -0,0 +1,163 @@
+#include "raster.h"
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	typedef std::vector<uint8_t> Row_t;
+
+	int readHeaderInt (std::istream& istr)
+	{
+		while (true)
+		{
+			const auto c = istr.peek ();
+			if (c == '#')
+				istr.ignore (std::numeric_limits<std::streamsize>::max (), '\n');
+			else if (std::isspace (c))
+				istr.get ();
+			else
+				break;
+		}
+
+		int value = -1;
+		if (!(istr >> value) || value <= 0)
+			throw std::runtime_error ("malformed raster header");
+		return value;
+	}
+
+	/* Fills the padded mask row (one spare byte on each side) with 0/1
+	 * foreground flags.
+	 */
+	void readP4Row (std::istream& istr, std::vector<char>& buf, uint8_t *mask, int width)
+	{
+		istr.read (buf.data (), buf.size ());
+		for (int x = 0; x < width; ++x)
+			mask [x + 1] = (static_cast<uint8_t> (buf [x >> 3]) >> (7 - (x & 7))) & 1;
+	}
+
+	void readP5Row (std::istream& istr, std::vector<char>& buf, uint8_t *mask, int width, int maxval)
+	{
+		istr.read (buf.data (), buf.size ());
+		const auto threshold = (maxval + 1) / 2;
+		if (maxval < 256)
+			for (int x = 0; x < width; ++x)
+				mask [x + 1] = static_cast<uint8_t> (buf [x]) < threshold;
+		else
+			for (int x = 0; x < width; ++x)
+			{
+				const auto hi = static_cast<uint8_t> (buf [2 * x]);
+				const auto lo = static_cast<uint8_t> (buf [2 * x + 1]);
+				mask [x + 1] = ((hi << 8) | lo) < threshold;
+			}
+	}
+
+	/* Boundary flags for the row cur: a foreground pixel is interior iff
+	 * all of its 4-neighbours are foreground as well. The loop is branchless
+	 * over bytes so that the compiler vectorizes it.
+	 */
+	void markBoundary (const uint8_t *up, const uint8_t *cur, const uint8_t *down, uint8_t *out, int width)
+	{
+		for (int x = 1; x <= width; ++x)
+			out [x] = cur [x] & ~(up [x] & down [x] & cur [x - 1] & cur [x + 1]) & 1;
+	}
+
+	void collectRow (const uint8_t *out, int width, int y, std::vector<Point_t>& pts)
+	{
+		int x = 1;
+		for (; x + 8 <= width + 1; x += 8)
+		{
+			uint64_t word;
+			std::memcpy (&word, out + x, sizeof (word));
+			if (!word)
+				continue;
+
+			for (int i = 0; i < 8; ++i)
+				if (out [x + i])
+					pts.push_back ({ x + i - 1, y });
+		}
+
+		for (; x <= width; ++x)
+			if (out [x])
+				pts.push_back ({ x - 1, y });
+	}
+}
+
+bool IsRasterFile (const std::string& filename)
+{
+	const auto dot = filename.rfind ('.');
+	if (dot == std::string::npos)
+		return false;
+
+	const auto ext = filename.substr (dot);
+	return ext == ".pbm" || ext == ".pgm";
+}
+
+std::vector<Point_t> ReadRasterContour (const std::string& filename)
+{
+	std::ifstream istr (filename, std::ios::binary);
+	if (!istr)
+		throw std::runtime_error ("unable to open " + filename);
+
+	return ReadRasterContour (istr, filename);
+}
+
+std::vector<Point_t> ReadRasterContour (std::istream& istr, const std::string& filename)
+{
+	char magic [2] = { 0 };
+	istr.read (magic, 2);
+	const bool isP4 = magic [0] == 'P' && magic [1] == '4';
+	const bool isP5 = magic [0] == 'P' && magic [1] == '5';
+	if (!isP4 && !isP5)
+		throw std::runtime_error (filename + " is not a binary PBM/PGM file");
+
+	const auto width = readHeaderInt (istr);
+	const auto height = readHeaderInt (istr);
+	const auto maxval = isP5 ? readHeaderInt (istr) : 1;
+	if (maxval > 65535)
+		throw std::runtime_error ("unsupported maxval in " + filename);
+	istr.get ();
+
+	const size_t rowBytes = isP4 ?
+			(width + 7) / 8 :
+			width * (maxval < 256 ? 1 : 2);
+	std::vector<char> buf (rowBytes);
+
+	// Three rolling padded mask rows, so that the scan needs only a single
+	// pass over the file and O(width) memory.
+	const size_t stride = width + 2;
+	Row_t rows (3 * stride, 0);
+	Row_t out (stride, 0);
+	uint8_t *up = &rows [0];
+	uint8_t *cur = &rows [stride];
+	uint8_t *down = &rows [2 * stride];
+
+	auto readRow = [&] (uint8_t *mask)
+	{
+		if (isP4)
+			readP4Row (istr, buf, mask, width);
+		else
+			readP5Row (istr, buf, mask, width, maxval);
+		if (!istr)
+			throw std::runtime_error ("truncated raster " + filename);
+	};
+
+	std::vector<Point_t> pts;
+	readRow (down);
+	for (int y = 0; y < height; ++y)
+	{
+		std::swap (up, cur);
+		std::swap (cur, down);
+		if (y + 1 < height)
+			readRow (down);
+		else
+			std::fill (down, down + stride, 0);
+
+		markBoundary (up, cur, down, &out [0], width);
+		collectRow (&out [0], width, y, pts);
+	}
+
+	if (pts.empty ())
+		throw std::runtime_error (filename + " contains no foreground pixels");
+	return pts;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "image.h"
+
+/** Reads a binary PBM (P4) or PGM (P5) silhouette and returns the
+ * boundary pixels of its foreground: the foreground pixels having at
+ * least one background 4-neighbour.
+ *
+ * Dark pixels are considered foreground: set bits for PBM and samples
+ * below half of maxval for PGM. An image without any foreground pixel
+ * is an error.
+ */
+std::vector<Point_t> ReadRasterContour (const std::string& filename);
+std::vector<Point_t> ReadRasterContour (std::istream& istr, const std::string& filename);
+
+bool IsRasterFile (const std::string& filename);
@@ -0,0 +1,118 @@
+#include "shapecache.h"
+#include <algorithm>
+
+namespace
+{
+	Point_t getOrigin (const std::vector<Point_t>& points)
+	{
+		auto minX = std::numeric_limits<Point_t::coordinate_type>::max ();
+		auto minY = minX;
+		for (const auto& p : points)
+		{
+			minX = std::min (minX, p.x ());
+			minY = std::min (minY, p.y ());
+		}
+		return { minX, minY };
+	}
+
+	// splitmix64 finalizer.
+	inline uint64_t mix (uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	uint64_t hashNormalized (const std::vector<Point_t>& points, const Point_t& origin)
+	{
+		const auto ox = origin.x (), oy = origin.y ();
+
+		// Summing the mixed points makes the hash independent of the order.
+		uint64_t sum = 0;
+		for (size_t i = 0; i < points.size (); ++i)
+		{
+			const uint64_t x = static_cast<uint32_t> (points [i].x () - ox);
+			const uint64_t y = static_cast<uint32_t> (points [i].y () - oy);
+			sum += mix ((x << 32) | y);
+		}
+		return mix (sum ^ points.size ());
+	}
+
+	std::vector<Point_t> normalize (const std::vector<Point_t>& points, const Point_t& origin)
+	{
+		std::vector<Point_t> result;
+		result.reserve (points.size ());
+		for (const auto& p : points)
+			result.push_back ({ p.x () - origin.x (), p.y () - origin.y () });
+		std::sort (result.begin (), result.end ());
+		return result;
+	}
+}
+
+uint64_t ShapeHash (const std::vector<Point_t>& points)
+{
+	return hashNormalized (points, getOrigin (points));
+}
+
+ShapeCache::ShapeCache ()
+: Total_ (0)
+, Deduplicated_ (0)
+{
+}
+
+Image_ptr ShapeCache::Get (const std::string& filename, std::vector<Point_t> points)
+{
+	if (points.empty ())
+		throw std::runtime_error (filename + " contains no points");
+
+	++Total_;
+
+	const auto origin = getOrigin (points);
+	const auto hash = hashNormalized (points, origin);
+	auto normalized = normalize (points, origin);
+
+	std::unique_lock<std::mutex> lock (Mutex_);
+
+	const auto range = Entries_.equal_range (hash);
+	const auto pos = std::find_if (range.first, range.second,
+			[&normalized] (const std::pair<const uint64_t, Entry>& pair)
+			{
+				return pair.second.Normalized_ == normalized;
+			});
+	if (pos != range.second)
+	{
+		const auto& entry = pos->second;
+		const auto future = entry.Image_;
+		const Point_t offset (origin.x () - entry.Origin_.x (), origin.y () - entry.Origin_.y ());
+		lock.unlock ();
+
+		++Deduplicated_;
+		return Image_ptr (new Image (filename, std::move (points), future.get (), offset));
+	}
+
+	std::promise<Image_ptr> promise;
+	Entries_.insert ({ hash, { std::move (normalized), origin, promise.get_future ().share () } });
+	lock.unlock ();
+
+	try
+	{
+		Image_ptr img (new Image (filename, std::move (points)));
+		promise.set_value (img);
+		return img;
+	}
+	catch (...)
+	{
+		promise.set_exception (std::current_exception ());
+		throw;
+	}
+}
+
+size_t ShapeCache::GetTotal () const
+{
+	return Total_;
+}
+
+size_t ShapeCache::GetDeduplicated () const
+{
+	return Deduplicated_;
+}
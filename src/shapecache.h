@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include "image.h"
+
+/** Builds Images, reusing the geometry of previously seen shapes.
+ *
+ * Two point sets are considered the same shape if they are equal up to
+ * point order and translation. Candidates are found by a canonical hash
+ * and confirmed by comparing the normalized point sets, so hash
+ * collisions never cause a wrong reuse.
+ *
+ * Get() may be called concurrently. If a duplicate arrives while the
+ * original is still being built, it waits for the original. An empty
+ * point set is not a shape, Get() throws for it.
+ */
+class ShapeCache
+{
+	struct Entry
+	{
+		std::vector<Point_t> Normalized_;
+		Point_t Origin_;
+		std::shared_future<Image_ptr> Image_;
+	};
+
+	std::mutex Mutex_;
+	std::unordered_multimap<uint64_t, Entry> Entries_;
+
+	std::atomic<size_t> Total_;
+	std::atomic<size_t> Deduplicated_;
+public:
+	ShapeCache ();
+
+	Image_ptr Get (const std::string& filename, std::vector<Point_t> points);
+
+	size_t GetTotal () const;
+	size_t GetDeduplicated () const;
+};
+
+/** Order-independent hash of the point set translated so that its
+ * bounding box starts at the origin.
+ */
+uint64_t ShapeHash (const std::vector<Point_t>& points);
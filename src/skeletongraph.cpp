@@ -0,0 +1,231 @@
+#include "skeletongraph.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace
+{
+	template<typename T>
+	void writeRaw (std::ostream& ostr, const T& value)
+	{
+		ostr.write (reinterpret_cast<const char*> (&value), sizeof (value));
+	}
+
+	template<typename T>
+	void writeRaw (std::ostream& ostr, const std::vector<T>& values)
+	{
+		if (!values.empty ())
+			ostr.write (reinterpret_cast<const char*> (values.data ()), values.size () * sizeof (T));
+	}
+}
+
+SkeletonGraph::SkeletonGraph (const std::vector<Edge_t>& edges)
+{
+	std::map<Vertex_t, uint32_t> ids;
+	std::vector<Vertex_t> vertices;
+	auto getId = [&ids, &vertices] (const Vertex_t& v)
+	{
+		const auto pos = ids.find (v);
+		if (pos != ids.end ())
+			return pos->second;
+
+		const auto id = static_cast<uint32_t> (vertices.size ());
+		ids [v] = id;
+		vertices.push_back (v);
+		return id;
+	};
+
+	std::vector<std::pair<uint32_t, uint32_t>> pairs;
+	pairs.reserve (edges.size ());
+	for (const auto& edge : edges)
+	{
+		const auto id0 = getId (edge.first);
+		const auto id1 = getId (edge.second);
+		if (id0 != id1)
+			pairs.push_back ({ std::min (id0, id1), std::max (id0, id1) });
+	}
+
+	Build (vertices, std::move (pairs));
+}
+
+size_t SkeletonGraph::GetVertexCount () const
+{
+	return Vertices_.size ();
+}
+
+size_t SkeletonGraph::GetDegree (uint32_t v) const
+{
+	return Offsets_ [v + 1] - Offsets_ [v];
+}
+
+void SkeletonGraph::PruneSpurs (double minLength)
+{
+	const auto count = static_cast<uint32_t> (Vertices_.size ());
+	std::vector<bool> removed (count, false);
+
+	std::vector<uint32_t> path;
+	for (uint32_t leaf = 0; leaf < count; ++leaf)
+	{
+		if (GetDegree (leaf) != 1)
+			continue;
+
+		path.assign (1, leaf);
+		auto prev = leaf;
+		auto cur = Adjacency_ [Offsets_ [leaf]];
+		auto length = Length (prev, cur);
+		while (GetDegree (cur) == 2 && length < minLength)
+		{
+			path.push_back (cur);
+			const auto next = Other (cur, prev);
+			prev = cur;
+			cur = next;
+			length += Length (prev, cur);
+		}
+
+		// A chain ending in another leaf is the whole component, not a spur.
+		if (GetDegree (cur) >= 3 && length < minLength)
+			for (auto v : path)
+				removed [v] = true;
+	}
+
+	if (std::find (removed.begin (), removed.end (), true) == removed.end ())
+		return;
+
+	std::vector<uint32_t> newIds (count);
+	std::vector<Vertex_t> vertices;
+	for (uint32_t v = 0; v < count; ++v)
+		if (!removed [v])
+		{
+			newIds [v] = static_cast<uint32_t> (vertices.size ());
+			vertices.push_back (Vertices_ [v]);
+		}
+
+	std::vector<std::pair<uint32_t, uint32_t>> pairs;
+	for (uint32_t v = 0; v < count; ++v)
+		for (auto i = Offsets_ [v]; i < Offsets_ [v + 1]; ++i)
+		{
+			const auto u = Adjacency_ [i];
+			if (v < u && !removed [v] && !removed [u])
+				pairs.push_back ({ newIds [v], newIds [u] });
+		}
+
+	Build (vertices, std::move (pairs));
+}
+
+std::vector<SkeletonGraph::Polyline_t> SkeletonGraph::GetPolylines () const
+{
+	std::vector<bool> visited (Adjacency_.size (), false);
+	auto markVisited = [this, &visited] (uint32_t from, uint32_t to)
+	{
+		for (auto i = Offsets_ [from]; i < Offsets_ [from + 1]; ++i)
+			if (Adjacency_ [i] == to && !visited [i])
+			{
+				visited [i] = true;
+				break;
+			}
+		for (auto i = Offsets_ [to]; i < Offsets_ [to + 1]; ++i)
+			if (Adjacency_ [i] == from && !visited [i])
+			{
+				visited [i] = true;
+				break;
+			}
+	};
+
+	std::vector<Polyline_t> result;
+	auto walk = [&] (uint32_t start, uint32_t first)
+	{
+		Polyline_t line { start, first };
+		markVisited (start, first);
+
+		auto prev = start;
+		auto cur = first;
+		while (GetDegree (cur) == 2 && cur != start)
+		{
+			const auto next = Other (cur, prev);
+			markVisited (cur, next);
+			line.push_back (next);
+			prev = cur;
+			cur = next;
+		}
+		result.push_back (std::move (line));
+	};
+
+	const auto count = static_cast<uint32_t> (Vertices_.size ());
+	for (uint32_t v = 0; v < count; ++v)
+		if (GetDegree (v) != 2)
+			for (auto i = Offsets_ [v]; i < Offsets_ [v + 1]; ++i)
+				if (!visited [i])
+					walk (v, Adjacency_ [i]);
+
+	for (uint32_t v = 0; v < count; ++v)
+		if (GetDegree (v) == 2 && !visited [Offsets_ [v]])
+			walk (v, Adjacency_ [Offsets_ [v]]);
+
+	return result;
+}
+
+void SkeletonGraph::Write (std::ostream& ostr, double dx, double dy) const
+{
+	ostr.write ("SKG1", 4);
+
+	writeRaw (ostr, static_cast<uint32_t> (Vertices_.size ()));
+	std::vector<float> coords;
+	coords.reserve (2 * Vertices_.size ());
+	for (const auto& v : Vertices_)
+	{
+		coords.push_back (v.first + dx);
+		coords.push_back (v.second + dy);
+	}
+	writeRaw (ostr, coords);
+	writeRaw (ostr, Offsets_);
+	writeRaw (ostr, Adjacency_);
+
+	const auto polylines = GetPolylines ();
+	std::vector<uint32_t> polyOffsets (1, 0);
+	std::vector<uint32_t> polyVertices;
+	for (const auto& line : polylines)
+	{
+		polyVertices.insert (polyVertices.end (), line.begin (), line.end ());
+		polyOffsets.push_back (static_cast<uint32_t> (polyVertices.size ()));
+	}
+	writeRaw (ostr, static_cast<uint32_t> (polylines.size ()));
+	writeRaw (ostr, polyOffsets);
+	writeRaw (ostr, polyVertices);
+}
+
+void SkeletonGraph::Build (const std::vector<Vertex_t>& vertices, std::vector<std::pair<uint32_t, uint32_t>> pairs)
+{
+	std::sort (pairs.begin (), pairs.end ());
+	pairs.erase (std::unique (pairs.begin (), pairs.end ()), pairs.end ());
+
+	Vertices_ = vertices;
+	Offsets_.assign (vertices.size () + 1, 0);
+	for (const auto& pair : pairs)
+	{
+		++Offsets_ [pair.first + 1];
+		++Offsets_ [pair.second + 1];
+	}
+	for (size_t i = 1; i < Offsets_.size (); ++i)
+		Offsets_ [i] += Offsets_ [i - 1];
+
+	Adjacency_.resize (Offsets_.back ());
+	auto fill = Offsets_;
+	for (const auto& pair : pairs)
+	{
+		Adjacency_ [fill [pair.first]++] = pair.second;
+		Adjacency_ [fill [pair.second]++] = pair.first;
+	}
+}
+
+double SkeletonGraph::Length (uint32_t v0, uint32_t v1) const
+{
+	const auto& p0 = Vertices_ [v0];
+	const auto& p1 = Vertices_ [v1];
+	return std::hypot (p0.first - p1.first, p0.second - p1.second);
+}
+
+uint32_t SkeletonGraph::Other (uint32_t vertex, uint32_t from) const
+{
+	const auto first = Adjacency_ [Offsets_ [vertex]];
+	return first == from ? Adjacency_ [Offsets_ [vertex] + 1] : first;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+/** Medial axis as an undirected graph in CSR form.
+ *
+ * Built from the edge list of the skeleton: coincident endpoints are merged
+ * into a single vertex, and repeated edges (like an edge and its twin) are
+ * stored once.
+ */
+class SkeletonGraph
+{
+public:
+	typedef std::pair<double, double> Vertex_t;
+	typedef std::pair<Vertex_t, Vertex_t> Edge_t;
+	typedef std::vector<uint32_t> Polyline_t;
+private:
+	std::vector<Vertex_t> Vertices_;
+	std::vector<uint32_t> Offsets_;
+	std::vector<uint32_t> Adjacency_;
+public:
+	SkeletonGraph (const std::vector<Edge_t>&);
+
+	size_t GetVertexCount () const;
+	size_t GetDegree (uint32_t) const;
+
+	/** Removes terminal branches (chains from a leaf to a junction) shorter
+	 * than minLength. Branches are measured against the original graph, so
+	 * pruning one spur never exposes another one in the same call.
+	 */
+	void PruneSpurs (double minLength);
+
+	/** Splits the graph into maximal chains whose inner vertices all have
+	 * degree 2. Cycles consisting of degree-2 vertices only are returned
+	 * with the first vertex repeated at the end.
+	 */
+	std::vector<Polyline_t> GetPolylines () const;
+
+	/** Writes the graph in the binary .skelg format, all values in native
+	 * byte order:
+	 *
+	 * "SKG1", uint32 V, float32 x/y [V], uint32 offsets [V + 1],
+	 * uint32 adjacency [offsets [V]], uint32 P, uint32 polyOffsets [P + 1],
+	 * uint32 polyVertices [polyOffsets [P]].
+	 */
+	void Write (std::ostream&, double dx, double dy) const;
+private:
+	void Build (const std::vector<Vertex_t>&, std::vector<std::pair<uint32_t, uint32_t>>);
+	double Length (uint32_t, uint32_t) const;
+	uint32_t Other (uint32_t vertex, uint32_t from) const;
+};
@@ -23,19 +23,20 @@ char modelfile[200];
 char predictionsfile[200];
 
 void read_input_parameters(int, char **, char *, char *, char *, long *, 
-			   long *);
+			   long *, long *);
 void print_help(void);
 
 
 int main (int argc, char* argv[])
 {
-  DOC *doc;   /* test example */
+  DOC **docs;   /* batch of test examples */
+  double *labels,*dists;
   WORD *words;
   long max_docs,max_words_doc,lld;
   long totdoc=0,queryid,slackid;
   long correct=0,incorrect=0,no_accuracy=0;
   long res_a=0,res_b=0,res_c=0,res_d=0,wnum,pred_format;
-  long j;
+  long j,num,batch,eof;
   double t1,runtime=0;
   double dist,doc_label,costfactor;
   char *line,*comment; 
@@ -43,7 +44,7 @@ int main (int argc, char* argv[])
   MODEL *model; 
 
   read_input_parameters(argc,argv,docfile,modelfile,predictionsfile,
-			&verbosity,&pred_format);
+			&verbosity,&pred_format,&batch);
 
   nol_ll(docfile,&max_docs,&max_words_doc,&lld); /* scan size of input file */
   max_words_doc+=2;
@@ -54,10 +55,24 @@ int main (int argc, char* argv[])
 
   model=read_model(modelfile);
 
+  if(model->kernel_parm.kernel_type == PRECOMPUTED) {
+    printf("\nError: Models with a precomputed kernel can not classify new examples\n");
+    exit(1);
+  }
+
   if(model->kernel_parm.kernel_type == 0) { /* linear kernel */
     /* compute weight vector */
     add_weight_vector_to_linear_model(model);
   }
+  else if(model->kernel_parm.kernel_type == RFF) {
+    /* weight vector and projection for the random Fourier features */
+    add_weight_vector_to_linear_model(model);
+    rff_init(&model->kernel_parm);
+  }
+  else {
+    /* flat support vectors for the non-linear kernels */
+    compile_model(model);
+  }
   
   if(verbosity>=2) {
     printf("Classifying test examples.."); fflush(stdout);
@@ -68,58 +83,82 @@ int main (int argc, char* argv[])
   if ((predfl = fopen (predictionsfile, "w")) == NULL)
   { perror (predictionsfile); exit (1); }
 
-  while((!feof(docfl)) && fgets(line,(int)lld,docfl)) {
-    if(line[0] == '#') continue;  /* line contains comments */
-    parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,&wnum,
-		   max_words_doc,&comment);
-    totdoc++;
-    if(model->kernel_parm.kernel_type == 0) {   /* linear kernel */
-      for(j=0;(words[j]).wnum != 0;j++) {  /* Check if feature numbers   */
-	if((words[j]).wnum>model->totwords) /* are not larger than in     */
-	  (words[j]).wnum=0;               /* model. Remove feature if   */
-      }                                        /* necessary.                 */
-      doc = create_example(-1,0,0,0.0,create_svector(words,comment,1.0));
-      t1=get_runtime();
-      dist=classify_example_linear(model,doc);
-      runtime+=(get_runtime()-t1);
-      free_example(doc,1);
-    }
-    else {                             /* non-linear kernel */
-      doc = create_example(-1,0,0,0.0,create_svector(words,comment,1.0));
-      t1=get_runtime();
-      dist=classify_example(model,doc);
-      runtime+=(get_runtime()-t1);
-      free_example(doc,1);
-    }
-    if(dist>0) {
-      if(pred_format==0) { /* old weired output format */
-	fprintf(predfl,"%.8g:+1 %.8g:-1\n",dist,-dist);
+  docs = (DOC **)my_malloc(sizeof(DOC *)*batch);
+  labels = (double *)my_malloc(sizeof(double)*batch);
+  dists = (double *)my_malloc(sizeof(double)*batch);
+  num=0;
+  while(1) {
+    eof=(feof(docfl) || !fgets(line,(int)lld,docfl));
+    if((!eof) && (line[0] != '#')) {  /* line contains no comment */
+      parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,
+		     &wnum,max_words_doc,&comment);
+      if(model->kernel_parm.kernel_type == 0) {   /* linear kernel */
+	for(j=0;(words[j]).wnum != 0;j++) {  /* Check if feature numbers   */
+	  if((words[j]).wnum>model->totwords) /* are not larger than in     */
+	    (words[j]).wnum=0;               /* model. Remove feature if   */
+	}                                        /* necessary.                 */
       }
-      if(doc_label>0) correct++; else incorrect++;
-      if(doc_label>0) res_a++; else res_b++;
+      docs[num] = create_example(-1,0,0,0.0,create_svector(words,comment,1.0));
+      labels[num++] = doc_label;
     }
-    else {
-      if(pred_format==0) { /* old weired output format */
-	fprintf(predfl,"%.8g:-1 %.8g:+1\n",-dist,dist);
+    if((num < batch) && (!eof)) 
+      continue;
+
+    t1=get_runtime();
+    if(batch == 1) {      /* classify one by one */
+      for(j=0;j<num;j++) {
+	if(model->kernel_parm.kernel_type == 0)    /* linear kernel */
+	  dists[j]=classify_example_linear(model,docs[j]);
+	else                                    /* non-linear kernel */
+	  dists[j]=classify_example(model,docs[j]);
       }
-      if(doc_label<0) correct++; else incorrect++;
-      if(doc_label>0) res_c++; else res_d++;
     }
-    if(pred_format==1) { /* output the value of decision function */
-      fprintf(predfl,"%.8g\n",dist);
+    else {
+      classify_examples(model,docs,num,dists);
     }
-    if((int)(0.01+(doc_label*doc_label)) != 1) 
-      { no_accuracy=1; } /* test data is not binary labeled */
-    if(verbosity>=2) {
-      if(totdoc % 100 == 0) {
-	printf("%ld..",totdoc); fflush(stdout);
+    runtime+=(get_runtime()-t1);
+
+    for(j=0;j<num;j++) {
+      totdoc++;
+      dist=dists[j];
+      doc_label=labels[j];
+      free_example(docs[j],1);
+      if(dist>0) {
+	if(pred_format==0) { /* old weired output format */
+	  fprintf(predfl,"%.8g:+1 %.8g:-1\n",dist,-dist);
+	}
+	if(doc_label>0) correct++; else incorrect++;
+	if(doc_label>0) res_a++; else res_b++;
+      }
+      else {
+	if(pred_format==0) { /* old weired output format */
+	  fprintf(predfl,"%.8g:-1 %.8g:+1\n",-dist,dist);
+	}
+	if(doc_label<0) correct++; else incorrect++;
+	if(doc_label>0) res_c++; else res_d++;
+      }
+      if(pred_format==1) { /* output the value of decision function */
+	fprintf(predfl,"%.8g\n",dist);
+      }
+      if((int)(0.01+(doc_label*doc_label)) != 1) 
+	{ no_accuracy=1; } /* test data is not binary labeled */
+      if(verbosity>=2) {
+	if(totdoc % 100 == 0) {
+	  printf("%ld..",totdoc); fflush(stdout);
+	}
       }
     }
+    num=0;
+    if(eof) break;
   }  
+  free(docs);
+  free(labels);
+  free(dists);
   fclose(predfl);
   fclose(docfl);
   free(line);
   free(words);
+  rff_cleanup(&model->kernel_parm);
   free_model(model,1);
 
   if(verbosity>=2) {
@@ -143,7 +182,8 @@ int main (int argc, char* argv[])
 
 void read_input_parameters(int argc, char **argv, char *docfile, 
 			   char *modelfile, char *predictionsfile, 
-			   long int *verbosity, long int *pred_format)
+			   long int *verbosity, long int *pred_format,
+			   long int *batch)
 {
   long i;
   
@@ -152,6 +192,7 @@ void read_input_parameters(int argc, char **argv, char *docfile,
   strcpy (predictionsfile, "svm_predictions"); 
   (*verbosity)=2;
   (*pred_format)=1;
+  (*batch)=1024;
 
   for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
     switch ((argv[i])[1]) 
@@ -159,6 +200,7 @@ void read_input_parameters(int argc, char **argv, char *docfile,
       case 'h': print_help(); exit(0);
       case 'v': i++; (*verbosity)=atol(argv[i]); break;
       case 'f': i++; (*pred_format)=atol(argv[i]); break;
+      case 'b': i++; (*batch)=atol(argv[i]); break;
       default: printf("\nUnrecognized option %s!\n\n",argv[i]);
 	       print_help();
 	       exit(0);
@@ -179,6 +221,11 @@ void read_input_parameters(int argc, char **argv, char *docfile,
     print_help();
     exit(0);
   }
+  if((*batch) < 1) {
+    printf("\nThe batch size must be at least 1!\n\n");
+    print_help();
+    exit(0);
+  }
 }
 
 void print_help(void)
@@ -189,7 +236,10 @@ void print_help(void)
   printf("options: -h         -> this help\n");
   printf("         -v [0..3]  -> verbosity level (default 2)\n");
   printf("         -f [0,1]   -> 0: old output format of V1.0\n");
-  printf("                    -> 1: output the value of decision function (default)\n\n");
+  printf("                    -> 1: output the value of decision function (default)\n");
+  printf("         -b int     -> number of examples read and classified at once,\n");
+  printf("                       in parallel for non-linear kernels (default 1024).\n");
+  printf("                       1 classifies the examples one by one.\n\n");
 }
 
 
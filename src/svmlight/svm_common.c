@@ -19,6 +19,10 @@
 # include "ctype.h"
 # include "svm_common.h"
 # include "kernel.h"           /* this contains a user supplied kernel */
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
 
 long   verbosity;              /* verbosity level (0-4) */
 long   kernel_cache_statistic;
@@ -28,11 +32,28 @@ double classify_example(MODEL *model, DOC *ex)
 {
   register long i;
   register double dist;
+  COMPILED_MODEL *cm=model->compiled;
+  SVECTOR *f;
 
   if((model->kernel_parm.kernel_type == LINEAR) && (model->lin_weights))
     return(classify_example_linear(model,ex));
+  if(model->kernel_parm.kernel_type == RFF)
+    return(classify_example_rff(model,ex));
 	   
   dist=0;
+  if(cm) {
+    for(f=ex->fvec;f;f=f->next) {
+      if(f->kernel_id) continue; /* compiled vectors all have id 0 */
+      for(i=0;i<cm->sv_num;i++) {
+	dist+=compiled_kernel(&model->kernel_parm,compiled_sprod(cm,i,f),
+			      cm->twonorm_sq[i],f->twonorm_sq)
+	      *f->factor*cm->alpha[i];
+      }
+#pragma omp atomic
+      kernel_cache_statistic+=cm->sv_num;
+    }
+    return(dist-model->b);
+  }
   for(i=1;i<model->sv_num;i++) {  
     dist+=kernel(&model->kernel_parm,model->supvec[i],ex)*model->alpha[i];
   }
@@ -57,20 +78,215 @@ double classify_example_linear(MODEL *model, DOC *ex)
   return(sum-model->b);
 }
 
+double classify_example_rff(MODEL *model, DOC *ex) 
+     /* classifies example for the rbf kernel approximated by random
+	Fourier features. The example is mapped on the fly, so this
+	takes time proportional to the number of features and not to
+	the number of support vectors. */
+
+     /* important: the model must have the linear weight vector and
+	the projection computed */
+     /* use: add_weight_vector_to_linear_model(&model); */
+     /*      rff_init(&model->kernel_parm);              */
+{
+  double sum=0;
+  SVECTOR *f;
+
+  for(f=ex->fvec;f;f=f->next)  
+    sum+=f->factor*rff_sprod(&model->kernel_parm,model->lin_weights,f);
+  return(sum-model->b);
+}
+
+
+void classify_examples(MODEL *model, DOC **ex, long n, double *dist)
+     /* classifies the n examples ex and writes the values of the
+	decision function to dist. Needs the model compiled with
+	compile_model, otherwise it calls classify_example for each
+	example. Traverses the support vectors once per block of
+	examples instead of once per example. A block is scattered into
+	a dense tile with the examples interleaved, so that the inner
+	loop over the block is contiguous for each feature of a support
+	vector. Blocks are classified in parallel. If the feature space
+	is too large for even a single example to fit into a tile,
+	the examples are classified one by one. */
+{
+  long block,blocknum,tilewords=0,i,evals=0;
+  COMPILED_MODEL *cm=model->compiled;
+
+  if(cm) 
+    tilewords=cm->dense ? cm->rowlen : cm->totwords+1;
+  if((!cm) || ((model->kernel_parm.kernel_type == LINEAR) 
+	       && (model->lin_weights))
+     || (model->kernel_parm.kernel_type == RFF)
+     || (tilewords > CLASSIFY_TILE_MAX)) {
+#pragma omp parallel for schedule(dynamic,CLASSIFY_BLOCK) if(n >= CLASSIFY_BLOCK)
+    for(i=0;i<n;i++) 
+      dist[i]=classify_example(model,ex[i]);
+    return;
+  }
+
+  block=minl(CLASSIFY_BLOCK,CLASSIFY_TILE_MAX/tilewords);
+  blocknum=(n+block-1)/block;
+
+#pragma omp parallel reduction(+:evals) if(blocknum > 1)
+  {
+    FVAL   *tile=(FVAL *)my_malloc(sizeof(FVAL)*tilewords*block);
+    double *dots=(double *)my_malloc(sizeof(double)*block);
+    long   b,e,k,m,w,end;
+    DOC    **blk;
+    WORD   *wp;
+    FVAL   val,*col,*row;
+
+    for(k=0;k<tilewords*block;k++)
+      tile[k]=0;
+
+#pragma omp for schedule(dynamic)
+    for(b=0;b<blocknum;b++) {
+      blk=ex+b*block;
+      m=minl(block,n-b*block);
+      for(e=0;e<m;e++) {
+	dist[b*block+e]=0;
+	if(blk[e]->fvec->next) continue; /* classified one by one below */
+	for(wp=blk[e]->fvec->words;wp->wnum;wp++) 
+	  if(wp->wnum <= cm->totwords)   /* feature unknown to the model */
+	    tile[wp->wnum*block+e]=wp->weight;
+      }
+
+      for(i=0;i<cm->sv_num;i++) {
+	for(e=0;e<m;e++) 
+	  dots[e]=0;
+	if(cm->dense) {
+	  row=cm->weight+i*cm->rowlen;
+	  for(w=1;w<=cm->totwords;w++) {
+	    val=row[w];
+	    col=tile+w*block;
+	    for(e=0;e<m;e++) 
+	      dots[e]+=val*col[e];
+	  }
+	}
+	else {
+	  end=cm->rowstart[i+1];
+	  for(k=cm->rowstart[i];k<end;k++) {
+	    val=cm->weight[k];
+	    col=tile+cm->wnum[k]*block;
+	    for(e=0;e<m;e++) 
+	      dots[e]+=val*col[e];
+	  }
+	}
+	for(e=0;e<m;e++) {
+	  dist[b*block+e]+=compiled_kernel(&model->kernel_parm,dots[e],
+					   cm->twonorm_sq[i],
+					   blk[e]->fvec->twonorm_sq)
+	                   *blk[e]->fvec->factor*cm->alpha[i];
+	}
+      }
+
+      for(e=0;e<m;e++) {
+	if(blk[e]->fvec->next) {
+	  dist[b*block+e]=classify_example(model,blk[e]);
+	  continue;
+	}
+	evals+=cm->sv_num;
+	for(wp=blk[e]->fvec->words;wp->wnum;wp++) 
+	  if(wp->wnum <= cm->totwords) 
+	    tile[wp->wnum*block+e]=0;
+	dist[b*block+e]-=model->b;
+      }
+    }
+
+    free(tile);
+    free(dots);
+  }
+#pragma omp atomic
+  kernel_cache_statistic+=evals;
+}
+
+double compiled_kernel(KERNEL_PARM *kernel_parm, double sprod, 
+		       double twonorm_sq_a, double twonorm_sq_b)
+     /* kernel function for the inner product sprod of two vectors
+	with the given squared lengths */
+{
+  switch(kernel_parm->kernel_type) {
+    case POLY: 
+            return(pow(kernel_parm->coef_lin*sprod+kernel_parm->coef_const,(double)kernel_parm->poly_degree)); 
+    case RBF:
+            return(exp(-kernel_parm->rbf_gamma*(twonorm_sq_a-2*sprod+twonorm_sq_b)));
+    case SIGMOID:
+            return(tanh(kernel_parm->coef_lin*sprod+kernel_parm->coef_const)); 
+    default: 
+            return(sprod);
+  }
+}
+
+double compiled_sprod(COMPILED_MODEL *cm, long i, SVECTOR *b)
+     /* inner product of the compiled support vector i and b */
+{
+  register double sum=0;
+  register WORD *bj=b->words;
+  register FNUM *ai;
+  register FVAL *aw,*row;
+  FNUM *end;
+
+  if(cm->dense) {
+    row=cm->weight+i*cm->rowlen;
+    for(;bj->wnum && (bj->wnum <= cm->totwords);bj++) 
+      sum+=row[bj->wnum]*bj->weight;
+    return(sum);
+  }
+  ai=cm->wnum+cm->rowstart[i];
+  aw=cm->weight+cm->rowstart[i];
+  end=cm->wnum+cm->rowstart[i+1];
+  while ((ai < end) && bj->wnum) {
+    if(*ai > bj->wnum) {
+      bj++;
+    }
+    else if (*ai < bj->wnum) {
+      ai++; aw++;
+    }
+    else {
+      sum+=(*aw) * (bj->weight);
+      ai++; aw++;
+      bj++;
+    }
+  }
+  return(sum);
+}
 
 double kernel(KERNEL_PARM *kernel_parm, DOC *a, DOC *b) 
      /* calculate the kernel function */
+{
+  long evals=0;
+  double sum;
+
+  sum=kernel_nostat(kernel_parm,a,b,&evals);
+#pragma omp atomic
+  kernel_cache_statistic+=evals;
+  return(sum);
+}
+
+double kernel_nostat(KERNEL_PARM *kernel_parm, DOC *a, DOC *b, long *evals) 
+     /* calculate the kernel function like kernel(), but add the number
+        of kernel evaluations to *evals instead of the global
+        kernel_cache_statistic. This allows calling it from several
+        threads at once. */
 {
   double sum=0;
   SVECTOR *fa,*fb;
 
+  if(kernel_parm->kernel_type == PRECOMPUTED) {
+    (*evals)++;
+    return(gram_lookup(kernel_parm,a->docnum,b->docnum));
+  }
+
   /* in case the constraints are sums of feature vector as represented
      as a list of SVECTOR's with their coefficient factor in the sum,
      take the kernel between all pairs */ 
   for(fa=a->fvec;fa;fa=fa->next) { 
     for(fb=b->fvec;fb;fb=fb->next) {
-      if(fa->kernel_id == fb->kernel_id)
-	sum+=fa->factor*fb->factor*single_kernel(kernel_parm,fa,fb);
+      if(fa->kernel_id == fb->kernel_id) {
+	sum+=fa->factor*fb->factor*single_kernel_nostat(kernel_parm,fa,fb);
+	(*evals)++;
+      }
     }
   }
   return(sum);
@@ -79,7 +295,15 @@ double kernel(KERNEL_PARM *kernel_parm, DOC *a, DOC *b)
 double single_kernel(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b) 
      /* calculate the kernel function between two vectors */
 {
+#pragma omp atomic
   kernel_cache_statistic++;
+  return(single_kernel_nostat(kernel_parm,a,b));
+}
+
+double single_kernel_nostat(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b) 
+     /* calculate the kernel function between two vectors without
+        updating kernel_cache_statistic */
+{
   switch(kernel_parm->kernel_type) {
     case 0: /* linear */ 
             return(sprod_ss(a,b)); 
@@ -91,10 +315,258 @@ double single_kernel(KERNEL_PARM *kernel_parm, SVECTOR *a, SVECTOR *b)
             return(tanh(kernel_parm->coef_lin*sprod_ss(a,b)+kernel_parm->coef_const)); 
     case 4: /* custom-kernel supplied in file kernel.h*/
             return(custom_kernel(kernel_parm,a,b)); 
+    case 5: /* precomputed, needs the document numbers */
+            printf("Error: Precomputed kernel used on feature vectors\n"); 
+	    exit(1);
+    case 6: /* random Fourier features, the vectors are already mapped */
+            return(sprod_ss(a,b)); 
     default: printf("Error: Unknown kernel function\n"); exit(1);
   }
 }
 
+double gram_lookup(KERNEL_PARM *kernel_parm, long a, long b)
+     /* Kernel value between the documents number a and b. Negative
+	document numbers denote the zero vector used by the estimators.
+	Document numbers beyond the matrix wrap around, since regression
+	represents every example by two documents. */
+{
+  if((a < 0) || (b < 0)) 
+    return(0);
+  return(kernel_parm->gram[(a % kernel_parm->gram_n)*kernel_parm->gram_n
+			   +(b % kernel_parm->gram_n)]);
+}
+
+float *gram_row(KERNEL_PARM *kernel_parm, long a)
+     /* Row of the Gram matrix for the document number a */
+{
+  return(kernel_parm->gram+(a % kernel_parm->gram_n)*kernel_parm->gram_n);
+}
+
+void gram_open(KERNEL_PARM *kernel_parm)
+     /* Maps the Gram matrix file kernel_parm->gram_file read-only, so
+	that concurrent training processes share it in the page cache. */
+{
+  int fd;
+  struct stat st;
+  char *map;
+  long long n;
+
+  if((fd=open(kernel_parm->gram_file,O_RDONLY)) == -1) {
+    perror(kernel_parm->gram_file);
+    exit(1);
+  }
+  if(fstat(fd,&st) == -1) {
+    perror(kernel_parm->gram_file);
+    exit(1);
+  }
+  map=(char *)mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    perror(kernel_parm->gram_file);
+    exit(1);
+  }
+  if(((size_t)st.st_size < strlen(GRAM_MAGIC)+sizeof(n))
+     || memcmp(map,GRAM_MAGIC,strlen(GRAM_MAGIC))) {
+    printf("\nError: %s is not a Gram matrix file\n",kernel_parm->gram_file);
+    exit(1);
+  }
+  memcpy(&n,map+strlen(GRAM_MAGIC),sizeof(n));
+  if((n <= 0) || ((size_t)st.st_size 
+		  != strlen(GRAM_MAGIC)+sizeof(n)+(size_t)n*n*sizeof(float))) {
+    printf("\nError: Gram matrix file %s is truncated\n",kernel_parm->gram_file);
+    exit(1);
+  }
+  kernel_parm->gram=(float *)(map+strlen(GRAM_MAGIC)+sizeof(n));
+  kernel_parm->gram_n=(long)n;
+  kernel_parm->gram_size=(size_t)st.st_size;
+}
+
+void gram_close(KERNEL_PARM *kernel_parm)
+{
+  if(kernel_parm->gram) {
+    munmap((char *)kernel_parm->gram-strlen(GRAM_MAGIC)-sizeof(long long),
+	   kernel_parm->gram_size);
+    kernel_parm->gram=NULL;
+  }
+}
+
+/* The rbf kernel exp(-gamma*||x-y||^2) is the expectation of
+   cos(w*(x-y)) for w drawn from N(0,2*gamma*I). With n=rff_dim/2 such
+   w_k, the map z(x) = sqrt(1/n)*(cos(w_1*x),sin(w_1*x),...,
+   cos(w_n*x),sin(w_n*x)) gives z(x)*z(y) ~ K(x,y), so that the linear
+   kernel on z(x) approximates the rbf kernel. The projection is not
+   stored in the model, but drawn again from rff_seed: column f of it,
+   the values of feature f in all w_k, depends only on the seed and f,
+   so that the first columns are the same for every rff_dim. */
+
+static unsigned long long rff_hash(unsigned long long x)
+     /* splitmix64 finalizer */
+{
+  x+=0x9e3779b97f4a7c15ULL;
+  x=(x^(x>>30))*0xbf58476d1ce4e5b9ULL;
+  x=(x^(x>>27))*0x94d049bb133111ebULL;
+  return(x^(x>>31));
+}
+
+static void rff_column(KERNEL_PARM *kernel_parm, long wnum, float *col)
+     /* draws column wnum of the projection, rff_dim/2 values from
+	N(0,2*gamma) by the Box-Muller method */
+{
+  long k,n=kernel_parm->rff_dim/2;
+  unsigned long long base;
+  double u1,u2,r,sd;
+
+  sd=sqrt(2.0*kernel_parm->rbf_gamma);
+  base=rff_hash(rff_hash((unsigned long long)kernel_parm->rff_seed)
+		^(unsigned long long)wnum);
+  for(k=0;k<n;k+=2) {
+    u1=((rff_hash(base+k)>>11)+0.5)/9007199254740992.0;  /* (0,1) */
+    u2=(rff_hash(base+k+1)>>11)/9007199254740992.0;      /* [0,1) */
+    r=sd*sqrt(-2.0*log(u1));
+    col[k]=(float)(r*cos(6.283185307179586*u2));
+    if(k+1 < n) 
+      col[k+1]=(float)(r*sin(6.283185307179586*u2));
+  }
+}
+
+void rff_init(KERNEL_PARM *kernel_parm)
+     /* draws the columns of the projection for the features up to
+	rff_words, as far as they fit into RFF_TABLE_MAX values */
+{
+  long f,n=kernel_parm->rff_dim/2;
+
+  kernel_parm->rff_projwords=minl(kernel_parm->rff_words,
+				  RFF_TABLE_MAX/maxl(n,1));
+  kernel_parm->rff_proj=(float *)my_malloc_aligned(sizeof(float)*n
+				      *(kernel_parm->rff_projwords+1));
+#pragma omp parallel for schedule(dynamic,64)
+  for(f=1;f<=kernel_parm->rff_projwords;f++) 
+    rff_column(kernel_parm,f,kernel_parm->rff_proj+f*n);
+}
+
+void rff_cleanup(KERNEL_PARM *kernel_parm)
+{
+  if(kernel_parm->rff_proj) {
+    free(kernel_parm->rff_proj);
+    kernel_parm->rff_proj=NULL;
+  }
+}
+
+static void rff_project(KERNEL_PARM *kernel_parm, SVECTOR *vec, 
+			double *proj)
+     /* proj[k] = w_k*vec for the n=rff_dim/2 random directions */
+{
+  long k,n=kernel_parm->rff_dim/2;
+  WORD *w;
+  float *col,*tmp=NULL;
+  double x;
+
+  for(k=0;k<n;k++) 
+    proj[k]=0;
+  for(w=vec->words;w->wnum;w++) {
+    if(w->wnum <= kernel_parm->rff_projwords) 
+      col=kernel_parm->rff_proj+w->wnum*n;
+    else {
+      if(!tmp) 
+	tmp=(float *)my_malloc(sizeof(float)*n);
+      rff_column(kernel_parm,w->wnum,tmp);
+      col=tmp;
+    }
+    x=w->weight;
+    for(k=0;k<n;k++) 
+      proj[k]+=x*col[k];
+  }
+  free(tmp);
+}
+
+static void rff_map_words(KERNEL_PARM *kernel_parm, SVECTOR *vec, 
+			  WORD *words)
+     /* writes the rff_dim random Fourier features of vec and the
+	terminating zero to words */
+{
+  long k,n=kernel_parm->rff_dim/2;
+  double *proj,scale;
+
+  proj=(double *)my_malloc(sizeof(double)*n);
+  rff_project(kernel_parm,vec,proj);
+  scale=sqrt(1.0/n);
+  for(k=0;k<n;k++) {
+    words[2*k].wnum=2*k+1;
+    words[2*k].weight=(FVAL)(scale*cos(proj[k]));
+    words[2*k+1].wnum=2*k+2;
+    words[2*k+1].weight=(FVAL)(scale*sin(proj[k]));
+  }
+  words[2*n].wnum=0;
+  free(proj);
+}
+
+SVECTOR *rff_map_svector(KERNEL_PARM *kernel_parm, SVECTOR *vec)
+     /* returns the random Fourier features z(vec) as a new vector
+	with the features 1..rff_dim, keeping factor and kernel_id */
+{
+  WORD *words;
+  SVECTOR *z;
+
+  words=(WORD *)my_malloc(sizeof(WORD)*(kernel_parm->rff_dim+1));
+  rff_map_words(kernel_parm,vec,words);
+  z=create_svector(words,vec->userdefined,vec->factor);
+  z->kernel_id=vec->kernel_id;
+  free(words);
+  return(z);
+}
+
+void rff_map_documents(KERNEL_PARM *kernel_parm, DOC **docs, long totdoc)
+     /* replaces the feature vectors of the documents read by
+	read_documents by their random Fourier features, so that they
+	can be trained with the linear kernel. The new vectors are kept
+	in one allocation like the ones they replace, so that
+	free_documents still releases them. The documents are mapped
+	in parallel. */
+{
+  long i,len=kernel_parm->rff_dim+1;
+  SVECTOR *vecs,*oldvecs;
+  WORD *words,*oldwords;
+
+  if(totdoc <= 0) 
+    return;
+  vecs=(SVECTOR *)my_malloc(sizeof(SVECTOR)*totdoc);
+  words=(WORD *)my_malloc(sizeof(WORD)*len*totdoc);
+#pragma omp parallel for schedule(dynamic,16)
+  for(i=0;i<totdoc;i++) {
+    rff_map_words(kernel_parm,docs[i]->fvec,words+i*len);
+    vecs[i]=(*docs[i]->fvec);
+    vecs[i].words=words+i*len;
+    vecs[i].twonorm_sq=sprod_ss(&vecs[i],&vecs[i]);
+  }
+  oldvecs=docs[0]->fvec;
+  oldwords=docs[0]->fvec->words;
+  for(i=0;i<totdoc;i++) 
+    docs[i]->fvec=&vecs[i];
+  free(oldwords);
+  free(oldvecs);
+}
+
+double rff_sprod(KERNEL_PARM *kernel_parm, double *weights, SVECTOR *vec)
+     /* inner product of the weight vector of features 1..rff_dim with
+	z(vec), without building z(vec) */
+{
+  long k,n=kernel_parm->rff_dim/2;
+  double *proj,*cosp,*sinp,sum=0;
+
+  proj=(double *)my_malloc(sizeof(double)*3*n);
+  cosp=proj+n;
+  sinp=proj+2*n;
+  rff_project(kernel_parm,vec,proj);
+  for(k=0;k<n;k++) {  /* separate loops, so that they vectorize */
+    cosp[k]=cos(proj[k]);
+    sinp[k]=sin(proj[k]);
+  }
+  for(k=0;k<n;k++) 
+    sum+=weights[2*k+1]*cosp[k]+weights[2*k+2]*sinp[k];
+  free(proj);
+  return(sum*sqrt(1.0/n));
+}
+
 
 SVECTOR *create_svector(WORD *words,char *userdefined,double factor)
 {
@@ -477,14 +949,149 @@ double sprod_ns(double *vec_n, SVECTOR *vec_s)
   return(sum);
 }
 
+SPARSE_ACCU *sparse_accu_init(long int n)
+     /* Creates an all-zero accumulator over the indices 0..n. It
+	remembers which entries it touched, so that clearing and dot
+	products cost time in the number of touched entries instead of
+	n, as long as few are touched. */
+{
+  SPARSE_ACCU *acc;
+
+  acc=(SPARSE_ACCU *)my_malloc(sizeof(SPARSE_ACCU));
+  acc->n=n;
+  acc->vec=(double *)my_malloc(sizeof(double)*(n+1));
+  clear_vector_n(acc->vec,n);
+  acc->maxtouched=(n+1)/ACCU_DENSE_RATIO;
+  acc->touched=(long *)my_malloc(sizeof(long)*(acc->maxtouched+1));
+  acc->touchednum=0;
+  acc->mergewnum=(long *)my_malloc(sizeof(long)*ACCU_MERGE_MAX);
+  acc->mergeval=(double *)my_malloc(sizeof(double)*ACCU_MERGE_MAX);
+  acc->mergenum=-1;
+  return(acc);
+}
+
+void sparse_accu_free(SPARSE_ACCU *acc)
+{
+  free(acc->vec);
+  free(acc->touched);
+  free(acc->mergewnum);
+  free(acc->mergeval);
+  free(acc);
+}
+
+void sparse_accu_clear(SPARSE_ACCU *acc)
+{
+  long i;
+
+  if(acc->touchednum > acc->maxtouched) 
+    clear_vector_n(acc->vec,acc->n);
+  else 
+    for(i=0;i<acc->touchednum;i++) 
+      acc->vec[acc->touched[i]]=0;
+  acc->touchednum=0;
+  acc->mergenum=-1;
+}
+
+void sparse_accu_add(SPARSE_ACCU *acc, SVECTOR *vec_s, double faktor)
+     /* Same as add_vector_ns on acc->vec. */
+{
+  register WORD *ai;
+
+  ai=vec_s->words;
+  while (ai->wnum) {
+    if(acc->vec[ai->wnum] == 0) {
+      if(acc->touchednum < acc->maxtouched) 
+	acc->touched[acc->touchednum]=ai->wnum;
+      acc->touchednum++;
+    }
+    acc->vec[ai->wnum]+=(faktor*ai->weight);
+    ai++;
+  }
+  acc->mergenum=-1;
+}
+
+static int compare_long(const void *a, const void *b)
+{
+  long x=*(const long *)a,y=*(const long *)b;
+  return((x > y) - (x < y));
+}
+
+void sparse_accu_compact(SPARSE_ACCU *acc)
+     /* Decides how sparse_accu_sprod reads the accumulator. If vec is
+	too large to stay in cache and at most ACCU_MERGE_MAX entries
+	are touched, the nonzeros are sorted into mergewnum/mergeval,
+	and dot products walk them together with the words of the
+	example. That avoids a cache miss for every word of the
+	example. Otherwise vec is read densely. */
+{
+  long i,j;
+
+  acc->mergenum=-1;
+  if((acc->n < ACCU_MERGE_MIN_N) || (acc->touchednum > ACCU_MERGE_MAX) 
+     || (acc->touchednum >= acc->maxtouched)) 
+    return;
+  qsort(acc->touched,acc->touchednum,sizeof(long),compare_long);
+  for(i=0,j=0;i<acc->touchednum;i++) {
+    if((i > 0) && (acc->touched[i] == acc->touched[i-1])) 
+      continue;
+    if(acc->vec[acc->touched[i]] != 0) {
+      acc->mergewnum[j]=acc->touched[i];
+      acc->mergeval[j]=acc->vec[acc->touched[i]];
+      j++;
+    }
+  }
+  acc->mergenum=j;
+}
+
+double sparse_accu_sprod(SPARSE_ACCU *acc, SVECTOR *vec_s)
+     /* Same as sprod_ns on acc->vec. */
+{
+  register double sum=0;
+  register WORD *ai;
+  register long j;
+
+  if(acc->mergenum < 0) 
+    return(sprod_ns(acc->vec,vec_s));
+  ai=vec_s->words;
+  j=0;
+  while (ai->wnum && (j < acc->mergenum)) {
+    if(ai->wnum > acc->mergewnum[j]) 
+      j++;
+    else if (ai->wnum < acc->mergewnum[j]) 
+      ai++;
+    else {
+      sum+=(acc->mergeval[j] * ai->weight);
+      ai++;
+      j++;
+    }
+  }
+  return(sum);
+}
+
 void add_weight_vector_to_linear_model(MODEL *model)
      /* compute weight vector in linear case and add to model */
 {
   long i;
   SVECTOR *f;
 
+  COMPILED_MODEL *cm=model->compiled;
+  long k;
+
+  if(model->lin_weights) /* read from a binary model file */
+    return;
   model->lin_weights=(double *)my_malloc(sizeof(double)*(model->totwords+1));
   clear_vector_n(model->lin_weights,model->totwords);
+  if(!model->supvec) {   /* only the compiled vectors are available */
+    for(i=0;i<cm->sv_num;i++) {
+      if(cm->dense) 
+	for(k=1;k<=cm->totwords;k++) 
+	  model->lin_weights[k]+=cm->alpha[i]*cm->weight[i*cm->rowlen+k];
+      else
+	for(k=cm->rowstart[i];k<cm->rowstart[i+1];k++) 
+	  model->lin_weights[cm->wnum[k]]+=cm->alpha[i]*cm->weight[k];
+    }
+    return;
+  }
   for(i=1;i<model->sv_num;i++) {
     for(f=(model->supvec[i])->fvec;f;f=f->next)  
       add_vector_ns(model->lin_weights,f,f->factor*model->alpha[i]);
@@ -492,6 +1099,140 @@ void add_weight_vector_to_linear_model(MODEL *model)
 }
 
 
+void compile_model(MODEL *model)
+     /* builds model->compiled, a flat copy of the support vectors for
+	classification: one allocation for all feature numbers and one
+	for all values, aligned arrays of alphas and lengths, and dense
+	rows if most features are nonzero. Identical support vectors
+	are merged by summing their alphas. Models with the custom or
+	the precomputed kernel are left as they are, since those need
+	the original documents, and so are models with random Fourier
+	features, which classify with their weight vector. */
+{
+  COMPILED_MODEL *cm;
+  SVECTOR *f,**vecs;
+  WORD   *w;
+  double *coef;
+  long   i,k,n,m,nnz,tabsize,*head,*next;
+  unsigned long h;
+  unsigned int bits;
+
+  if(model->compiled 
+     || (model->kernel_parm.kernel_type == CUSTOM)
+     || (model->kernel_parm.kernel_type == PRECOMPUTED)
+     || (model->kernel_parm.kernel_type == RFF))
+    return;
+
+  n=0;
+  for(i=1;i<model->sv_num;i++) 
+    for(f=model->supvec[i]->fvec;f;f=f->next) 
+      n++;
+  vecs=(SVECTOR **)my_malloc(sizeof(SVECTOR *)*(n+1));
+  coef=(double *)my_malloc(sizeof(double)*(n+1));
+  n=0;
+  for(i=1;i<model->sv_num;i++) 
+    for(f=model->supvec[i]->fvec;f;f=f->next) 
+      if(f->kernel_id == 0) {  /* others never meet a single vector */
+	vecs[n]=f;
+	coef[n++]=model->alpha[i]*f->factor;
+      }
+
+  /* merge identical vectors in place, chaining the distinct ones
+     in a hash table over their nonzeros */
+  for(tabsize=1;tabsize<2*n;tabsize*=2);
+  head=(long *)my_malloc(sizeof(long)*tabsize);
+  next=(long *)my_malloc(sizeof(long)*(n+1));
+  for(k=0;k<tabsize;k++) 
+    head[k]=-1;
+  m=0;
+  for(i=0;i<n;i++) {
+    h=0;
+    for(w=vecs[i]->words;w->wnum;w++) 
+      if(w->weight != 0) {
+	memcpy(&bits,&w->weight,sizeof(bits));
+	h=(h^((unsigned long)w->wnum<<32)^bits)*0x100000001b3UL;
+      }
+    h&=tabsize-1;
+    for(k=head[h];(k>=0) && (!featvec_eq(vecs[k],vecs[i]));k=next[k]);
+    if(k>=0) {
+      coef[k]+=coef[i];
+      continue;
+    }
+    vecs[m]=vecs[i];
+    coef[m]=coef[i];
+    next[m]=head[h];
+    head[h]=m++;
+  }
+  free(head);
+  free(next);
+
+  cm=(COMPILED_MODEL *)my_malloc(sizeof(COMPILED_MODEL));
+  cm->sv_num=m;
+  cm->totwords=model->totwords;
+  cm->alpha=(double *)my_malloc_aligned(sizeof(double)*(m+1));
+  cm->twonorm_sq=(double *)my_malloc_aligned(sizeof(double)*(m+1));
+  nnz=0;
+  for(i=0;i<m;i++) {
+    cm->alpha[i]=coef[i];
+    cm->twonorm_sq[i]=vecs[i]->twonorm_sq;
+    for(w=vecs[i]->words;w->wnum;w++) 
+      if(w->weight != 0) 
+	nnz++;
+  }
+  cm->rowlen=(cm->totwords+16)/16*16;
+  cm->dense=(nnz >= COMPILE_DENSE_MIN*m*cm->totwords);
+  if(cm->dense) {
+    cm->rowstart=NULL;
+    cm->wnum=NULL;
+    cm->weight=(FVAL *)my_malloc_aligned(sizeof(FVAL)*m*cm->rowlen+1);
+    for(k=0;k<m*cm->rowlen;k++) 
+      cm->weight[k]=0;
+    for(i=0;i<m;i++) 
+      for(w=vecs[i]->words;w->wnum;w++) 
+	cm->weight[i*cm->rowlen+w->wnum]=w->weight;
+  }
+  else {
+    cm->rowstart=(long *)my_malloc(sizeof(long)*(m+1));
+    cm->wnum=(FNUM *)my_malloc_aligned(sizeof(FNUM)*(nnz+1));
+    cm->weight=(FVAL *)my_malloc_aligned(sizeof(FVAL)*(nnz+1));
+    k=0;
+    for(i=0;i<m;i++) {
+      cm->rowstart[i]=k;
+      for(w=vecs[i]->words;w->wnum;w++) 
+	if(w->weight != 0) {
+	  cm->wnum[k]=w->wnum;
+	  cm->weight[k++]=w->weight;
+	}
+    }
+    cm->rowstart[m]=k;
+  }
+  free(vecs);
+  free(coef);
+  cm->map=NULL;
+  cm->map_size=0;
+  model->compiled=cm;
+
+  if(verbosity>=1) {
+    printf("Compiled %ld distinct support vectors (%s rows).\n",m,
+	   cm->dense ? "dense" : "sparse");
+  }
+}
+
+void free_compiled_model(COMPILED_MODEL *cm)
+{
+  if(cm->map) {
+    munmap(cm->map,cm->map_size);
+    free(cm);
+    return;
+  }
+  if(cm->rowstart) free(cm->rowstart);
+  if(cm->wnum) free(cm->wnum);
+  free(cm->weight);
+  free(cm->alpha);
+  free(cm->twonorm_sq);
+  free(cm);
+}
+
 DOC *create_example(long docnum, long queryid, long slackid, 
 		    double costfactor, SVECTOR *fvec)
 {
@@ -539,9 +1280,44 @@ void write_model(char *modelfile, MODEL *model)
   fprintf(modelfl,"%.8g # kernel parameter -r \n",
 	  model->kernel_parm.coef_const);
   fprintf(modelfl,"%s# kernel parameter -u \n",model->kernel_parm.custom);
+  if(model->kernel_parm.kernel_type == RFF) {
+    fprintf(modelfl,"%ld # kernel parameter -F \n",
+	    model->kernel_parm.rff_dim);
+    fprintf(modelfl,"%ld # kernel parameter -R \n",
+	    model->kernel_parm.rff_seed);
+    fprintf(modelfl,"%ld # highest feature index of the projection \n",
+	    model->kernel_parm.rff_words);
+  }
   fprintf(modelfl,"%ld # highest feature index \n",model->totwords);
   fprintf(modelfl,"%ld # number of training documents \n",model->totdoc);
  
+  if(model->kernel_parm.kernel_type == RFF) {
+    /* the weight vector is the only support vector */
+    add_weight_vector_to_linear_model(model);
+    fprintf(modelfl,"2 # number of support vectors plus 1 \n");
+    fprintf(modelfl,"%.8g # threshold b, each following line is a SV (starting with alpha*y)\n",model->b);
+    fprintf(modelfl,"1 ");
+    for(j=1;j<=model->totwords;j++) {
+      if(model->lin_weights[j] != 0) 
+	fprintf(modelfl,"%ld:%.8g ",j,model->lin_weights[j]);
+    }
+    fprintf(modelfl,"#\n");
+    fclose(modelfl);
+    if(verbosity>=1) {
+      printf("done\n");
+    }
+    return;
+  }
+
+  if(!model->supvec) {   /* read from a binary model file */
+    write_compiled_svs(modelfl,model);
+    fclose(modelfl);
+    if(verbosity>=1) {
+      printf("done\n");
+    }
+    return;
+  }
+
   sv_num=1;
   for(i=1;i<model->sv_num;i++) {
     for(v=model->supvec[i]->fvec;v;v=v->next) 
@@ -571,6 +1347,230 @@ void write_model(char *modelfile, MODEL *model)
 }
 
 
+void write_compiled_svs(FILE *modelfl, MODEL *model)
+     /* writes the support vector part of a text model file from the
+	compiled support vectors */
+{
+  COMPILED_MODEL *cm=model->compiled;
+  long i,k;
+
+  fprintf(modelfl,"%ld # number of support vectors plus 1 \n",cm->sv_num+1);
+  fprintf(modelfl,"%.8g # threshold b, each following line is a SV (starting with alpha*y)\n",model->b);
+  for(i=0;i<cm->sv_num;i++) {
+    fprintf(modelfl,"%.32g ",cm->alpha[i]);
+    if(cm->dense) {
+      for(k=1;k<=cm->totwords;k++) 
+	if(cm->weight[i*cm->rowlen+k] != 0) 
+	  fprintf(modelfl,"%ld:%.8g ",k,(double)cm->weight[i*cm->rowlen+k]);
+    }
+    else {
+      for(k=cm->rowstart[i];k<cm->rowstart[i+1];k++) 
+	fprintf(modelfl,"%ld:%.8g ",(long)cm->wnum[k],(double)cm->weight[k]);
+    }
+    fprintf(modelfl,"#\n");
+  }
+}
+
+static long long binary_model_put(FILE *fl, long long pos, void *data, 
+				  size_t size)
+     /* writes size bytes of data at the next 64 byte boundary after
+	pos and returns the position of the data */
+{
+  static char zeros[64];
+  long long start=(pos+63)/64*64;
+
+  fwrite(zeros,1,(size_t)(start-pos),fl);
+  if(size && (fwrite(data,1,size,fl) != size)) {
+    perror("Error writing binary model file");
+    exit(1);
+  }
+  return(start);
+}
+
+void write_binary_model(char *modelfile, MODEL *model)
+     /* writes the model in the binary format, which read_binary_model
+	maps into memory. The support vectors are stored compiled (see
+	compile_model), linear models additionally with their weight
+	vector. All values are in the byte order of the writer. */
+{
+  FILE *modelfl;
+  BINARY_MODEL_HEADER h;
+  COMPILED_MODEL *cm;
+  long long pos;
+  long m;
+
+  if((model->kernel_parm.kernel_type == CUSTOM)
+     || (model->kernel_parm.kernel_type == PRECOMPUTED)
+     || (model->kernel_parm.kernel_type == RFF)) {
+    printf("\nError: Models with a custom, precomputed, or random Fourier feature kernel can not be written in binary format\n");
+    exit(1);
+  }
+  compile_model(model);
+  if(model->kernel_parm.kernel_type == LINEAR)
+    add_weight_vector_to_linear_model(model);
+  cm=model->compiled;
+  m=cm->sv_num;
+
+  if(verbosity>=1) {
+    printf("Writing binary model file..."); fflush(stdout);
+  }
+  if ((modelfl = fopen (modelfile, "wb")) == NULL)
+  { perror (modelfile); exit (1); }
+
+  memset(&h,0,sizeof(h));
+  memcpy(h.magic,BINARY_MODEL_MAGIC,sizeof(h.magic));
+  h.version=BINARY_MODEL_VERSION;
+  h.byteorder=0x01020304;
+  h.fnum_size=sizeof(FNUM);
+  h.fval_size=sizeof(FVAL);
+  h.long_size=sizeof(long);
+  h.lin_weights=(model->lin_weights != NULL);
+  h.kernel_type=model->kernel_parm.kernel_type;
+  h.poly_degree=model->kernel_parm.poly_degree;
+  h.rbf_gamma=model->kernel_parm.rbf_gamma;
+  h.coef_lin=model->kernel_parm.coef_lin;
+  h.coef_const=model->kernel_parm.coef_const;
+  strncpy(h.custom,model->kernel_parm.custom,sizeof(h.custom)-1);
+  h.totwords=model->totwords;
+  h.totdoc=model->totdoc;
+  h.at_upper_bound=model->at_upper_bound;
+  h.b=model->b;
+  h.sv_num=m;
+  h.dense=cm->dense;
+  h.rowlen=cm->rowlen;
+  h.nnz=cm->dense ? 0 : cm->rowstart[m];
+
+  /* the header is written twice, first to reserve its space and then
+     with the final array positions */
+  fwrite(&h,sizeof(h),1,modelfl);
+  pos=sizeof(h);
+  h.alpha_pos=binary_model_put(modelfl,pos,cm->alpha,sizeof(double)*m);
+  pos=h.alpha_pos+sizeof(double)*m;
+  h.twonorm_sq_pos=binary_model_put(modelfl,pos,cm->twonorm_sq,
+				    sizeof(double)*m);
+  pos=h.twonorm_sq_pos+sizeof(double)*m;
+  if(cm->dense) {
+    h.weight_pos=binary_model_put(modelfl,pos,cm->weight,
+				  sizeof(FVAL)*m*cm->rowlen);
+    pos=h.weight_pos+sizeof(FVAL)*m*cm->rowlen;
+  }
+  else {
+    h.rowstart_pos=binary_model_put(modelfl,pos,cm->rowstart,
+				    sizeof(long)*(m+1));
+    pos=h.rowstart_pos+sizeof(long)*(m+1);
+    h.wnum_pos=binary_model_put(modelfl,pos,cm->wnum,sizeof(FNUM)*h.nnz);
+    pos=h.wnum_pos+sizeof(FNUM)*h.nnz;
+    h.weight_pos=binary_model_put(modelfl,pos,cm->weight,sizeof(FVAL)*h.nnz);
+    pos=h.weight_pos+sizeof(FVAL)*h.nnz;
+  }
+  if(h.lin_weights) {
+    h.lin_weights_pos=binary_model_put(modelfl,pos,model->lin_weights,
+				       sizeof(double)*(model->totwords+1));
+  }
+  rewind(modelfl);
+  fwrite(&h,sizeof(h),1,modelfl);
+  if(fclose(modelfl)) {
+    perror (modelfile); exit (1);
+  }
+  if(verbosity>=1) {
+    printf("done\n");
+  }
+}
+
+MODEL *read_binary_model(char *modelfile)
+     /* maps a model file written by write_binary_model. The compiled
+	support vectors point into the mapping, so loading takes no
+	time per support vector. The model has no supvec and alpha
+	arrays, only model->compiled. */
+{
+  int fd;
+  struct stat st;
+  char *map;
+  BINARY_MODEL_HEADER h;
+  MODEL *model;
+  COMPILED_MODEL *cm;
+  long long end;
+
+  if(verbosity>=1) {
+    printf("Reading binary model..."); fflush(stdout);
+  }
+  if((fd=open(modelfile,O_RDONLY)) == -1) {
+    perror(modelfile);
+    exit(1);
+  }
+  if(fstat(fd,&st) == -1) {
+    perror(modelfile);
+    exit(1);
+  }
+  map=(char *)mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    perror(modelfile);
+    exit(1);
+  }
+  if(((size_t)st.st_size < sizeof(h))
+     || memcmp(map,BINARY_MODEL_MAGIC,strlen(BINARY_MODEL_MAGIC))) {
+    printf("\nError: %s is not a binary model file\n",modelfile);
+    exit(1);
+  }
+  memcpy(&h,map,sizeof(h));
+  if((h.version != BINARY_MODEL_VERSION) || (h.byteorder != 0x01020304)
+     || (h.fnum_size != sizeof(FNUM)) || (h.fval_size != sizeof(FVAL))
+     || (h.long_size != sizeof(long))) {
+    printf("\nError: Binary model file %s was written by an incompatible version or machine\n",modelfile);
+    exit(1);
+  }
+  end=h.lin_weights ? h.lin_weights_pos+(long long)sizeof(double)*(h.totwords+1)
+    : h.weight_pos+(long long)sizeof(FVAL)*(h.dense ? h.sv_num*h.rowlen : h.nnz);
+  if(end > (long long)st.st_size) {
+    printf("\nError: Binary model file %s is truncated\n",modelfile);
+    exit(1);
+  }
+
+  model=(MODEL *)my_malloc(sizeof(MODEL));
+  memset(model,0,sizeof(MODEL));
+  model->kernel_parm.kernel_type=h.kernel_type;
+  model->kernel_parm.poly_degree=h.poly_degree;
+  model->kernel_parm.rbf_gamma=h.rbf_gamma;
+  model->kernel_parm.coef_lin=h.coef_lin;
+  model->kernel_parm.coef_const=h.coef_const;
+  memcpy(model->kernel_parm.custom,h.custom,sizeof(model->kernel_parm.custom));
+  model->kernel_parm.custom[sizeof(model->kernel_parm.custom)-1]=0;
+  model->totwords=h.totwords;
+  model->totdoc=h.totdoc;
+  model->at_upper_bound=h.at_upper_bound;
+  model->b=h.b;
+  model->sv_num=h.sv_num+1;
+  model->supvec=NULL;
+  model->alpha=NULL;
+  model->index=NULL;
+  model->lin_weights=NULL;
+  if(h.lin_weights) {   /* one copy, since free_model frees it */
+    model->lin_weights=(double *)my_malloc(sizeof(double)*(h.totwords+1));
+    memcpy(model->lin_weights,map+h.lin_weights_pos,
+	   sizeof(double)*(h.totwords+1));
+  }
+
+  cm=(COMPILED_MODEL *)my_malloc(sizeof(COMPILED_MODEL));
+  cm->sv_num=h.sv_num;
+  cm->totwords=h.totwords;
+  cm->dense=h.dense;
+  cm->rowlen=h.rowlen;
+  cm->alpha=(double *)(map+h.alpha_pos);
+  cm->twonorm_sq=(double *)(map+h.twonorm_sq_pos);
+  cm->rowstart=h.dense ? NULL : (long *)(map+h.rowstart_pos);
+  cm->wnum=h.dense ? NULL : (FNUM *)(map+h.wnum_pos);
+  cm->weight=(FVAL *)(map+h.weight_pos);
+  cm->map=map;
+  cm->map_size=(size_t)st.st_size;
+  model->compiled=cm;
+
+  if(verbosity>=1) {
+    fprintf(stdout, "OK. (%ld support vectors read)\n",cm->sv_num);
+  }
+  return(model);
+}
+
 MODEL *read_model(char *modelfile)
 {
   FILE *modelfl;
@@ -582,6 +1582,17 @@ MODEL *read_model(char *modelfile)
   char version_buffer[100];
   MODEL *model;
 
+  if((modelfl = fopen (modelfile, "rb")) == NULL)
+  { perror (modelfile); exit (1); }
+  if((fread(version_buffer,1,strlen(BINARY_MODEL_MAGIC),modelfl)
+      == strlen(BINARY_MODEL_MAGIC))
+     && (!memcmp(version_buffer,BINARY_MODEL_MAGIC,
+		 strlen(BINARY_MODEL_MAGIC)))) {
+    fclose(modelfl);
+    return(read_binary_model(modelfile));
+  }
+  fclose(modelfl);
+
   if(verbosity>=1) {
     printf("Reading model..."); fflush(stdout);
   }
@@ -608,6 +1619,15 @@ MODEL *read_model(char *modelfile)
   fscanf(modelfl,"%lf%*[^\n]\n", &model->kernel_parm.coef_lin);
   fscanf(modelfl,"%lf%*[^\n]\n", &model->kernel_parm.coef_const);
   fscanf(modelfl,"%[^#]%*[^\n]\n", model->kernel_parm.custom);
+  model->kernel_parm.gram_file[0]=0;
+  model->kernel_parm.gram=NULL;
+  model->kernel_parm.rff_dim=0;
+  model->kernel_parm.rff_proj=NULL;
+  if(model->kernel_parm.kernel_type == RFF) {
+    fscanf(modelfl,"%ld%*[^\n]\n", &model->kernel_parm.rff_dim);
+    fscanf(modelfl,"%ld%*[^\n]\n", &model->kernel_parm.rff_seed);
+    fscanf(modelfl,"%ld%*[^\n]\n", &model->kernel_parm.rff_words);
+  }
 
   fscanf(modelfl,"%ld%*[^\n]\n", &model->totwords);
   fscanf(modelfl,"%ld%*[^\n]\n", &model->totdoc);
@@ -618,6 +1638,7 @@ MODEL *read_model(char *modelfile)
   model->alpha = (double *)my_malloc(sizeof(double)*model->sv_num);
   model->index=NULL;
   model->lin_weights=NULL;
+  model->compiled=NULL;
 
   for(i=1;i<model->sv_num;i++) {
     fgets(line,(int)ll,modelfl);
@@ -651,6 +1672,7 @@ MODEL *copy_model(MODEL *model)
   newmodel->supvec = (DOC **)my_malloc(sizeof(DOC *)*model->sv_num);
   newmodel->alpha = (double *)my_malloc(sizeof(double)*model->sv_num);
   newmodel->index = NULL; /* index is not copied */
+  newmodel->compiled = NULL; /* neither is the compiled model */
   newmodel->supvec[0] = NULL;
   newmodel->alpha[0] = 0;
   for(i=1;i<model->sv_num;i++) {
@@ -683,81 +1705,370 @@ void free_model(MODEL *model, int deep)
   if(model->alpha) free(model->alpha);
   if(model->index) free(model->index);
   if(model->lin_weights) free(model->lin_weights);
+  if(model->compiled) free_compiled_model(model->compiled);
   free(model);
 }
 
 
-void read_documents(char *docfile, DOC ***docs, double **label, 
-		    long int *totwords, long int *totdoc)
+typedef struct doc_chunk {
+  char   *start,*end;        /* lines of the file in this chunk */
+  long   docs,maxdocs;       /* documents parsed so far */
+  long   words,maxwords;     /* features including the terminators */
+  long   chars,maxchars;     /* comment characters including the NULs */
+  DOC    *doc;               /* parsed documents, without fvec */
+  double *label;
+  long   *fnum;              /* number of features plus terminator */
+  WORD   *word;
+  char   *comment;
+  long   totwords;           /* highest feature number */
+} DOC_CHUNK;
+
+static void *grow_array(void *ptr, long *max, long need, size_t size)
+     /* makes room for need elements of the given size in the array ptr
+	of *max elements */
 {
-  char *line,*comment;
-  WORD *words;
-  long dnum=0,wpos,dpos=0,dneg=0,dunlab=0,queryid,slackid,max_docs;
-  long max_words_doc, ll;
-  double doc_label,costfactor;
-  FILE *docfl;
+  if(need <= (*max)) 
+    return(ptr);
+  (*max)=maxl(need,2*(*max)+16);
+  ptr=realloc(ptr,size*(*max));
+  if(!ptr) { 
+    perror ("Out of memory!\n"); 
+    exit (1); 
+  }
+  return(ptr);
+}
 
-  if(verbosity>=1) {
-    printf("Scanning examples..."); fflush(stdout);
+static char *scan_long(char *p, char *end, long *val)
+     /* reads a decimal integer from p, returns the position after it
+	or NULL */
+{
+  long v=0,neg=0;
+  char *start;
+
+  if((p<end) && ((*p=='-') || (*p=='+'))) 
+    neg=(*(p++)=='-');
+  start=p;
+  while((p<end) && (*p>='0') && (*p<='9')) 
+    v=v*10+(*(p++)-'0');
+  if(p==start) 
+    return(NULL);
+  (*val)=neg ? -v : v;
+  return(p);
+}
+
+static char *scan_double(char *p, char *end, double *val)
+     /* reads a floating point number from p, returns the position
+	after it or NULL. Numbers with up to 15 significant digits and
+	a decimal exponent of up to 22 are exact in double precision and
+	computed directly, all others are left to strtod. The result is
+	correctly rounded either way, like with sscanf. */
+{
+  static const double pow10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,
+			       1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,
+			       1e18,1e19,1e20,1e21,1e22};
+  char buf[128],*q,*stop;
+  unsigned long long m=0;
+  long digits=0,exp10=0,e=0,neg=0,any=0;
+
+  q=p;
+  if((q<end) && ((*q=='-') || (*q=='+'))) 
+    neg=(*(q++)=='-');
+  for(;(q<end) && (*q>='0') && (*q<='9');q++,any=1) 
+    if(m || (*q!='0')) { 
+      m=m*10+(*q-'0'); 
+      digits++; 
+    }
+  if((q<end) && (*q=='.')) { 
+    for(q++;(q<end) && (*q>='0') && (*q<='9');q++,any=1) { 
+      if(m || (*q!='0')) { 
+	m=m*10+(*q-'0'); 
+	digits++; 
+	exp10--; 
+      }
+      else 
+	exp10--;
+    }
   }
-  nol_ll(docfile,&max_docs,&max_words_doc,&ll); /* scan size of input file */
-  max_words_doc+=2;
-  ll+=2;
-  max_docs+=2;
-  if(verbosity>=1) {
-    printf("done\n"); fflush(stdout);
+  if(any && (q<end) && ((*q=='e') || (*q=='E'))) {
+    stop=scan_long(q+1,end,&e);
+    if(stop) { 
+      q=stop; 
+      exp10+=e; 
+    }
+  }
+  if(any && (digits<=15) && (exp10>=-22) && (exp10<=22)) {
+    (*val)=(exp10<0) ? (double)m/pow10[-exp10] : (double)m*pow10[exp10];
+    if(neg) (*val)=-(*val);
+    return(q);
   }
 
-  (*docs) = (DOC **)my_malloc(sizeof(DOC *)*max_docs);    /* feature vectors */
-  (*label) = (double *)my_malloc(sizeof(double)*max_docs); /* target values */
-  line = (char *)my_malloc(sizeof(char)*ll);
+  /* everything else, like long mantissas, inf and nan */
+  if((end-p) >= (long)sizeof(buf)) 
+    end=p+sizeof(buf)-1;
+  memcpy(buf,p,(size_t)(end-p));
+  buf[end-p]=0;
+  (*val)=strtod(buf,&stop);
+  if(stop==buf) 
+    return(NULL);
+  return(p+(stop-buf));
+}
 
-  if ((docfl = fopen (docfile, "r")) == NULL)
-  { perror (docfile); exit (1); }
+static void parse_chunk(DOC_CHUNK *c)
+     /* parses the lines of the chunk like parse_document */
+{
+  char *p,*le,*ce,*ts,*te,*hash,*q;
+  long wnum,first,nfeat,len,max;
+  double v;
+  DOC *d;
+
+  for(p=c->start;p<c->end;p=le+1) {
+    le=(char *)memchr(p,'\n',(size_t)(c->end-p));
+    if(!le) le=c->end;
+    if(*p == '#') continue;  /* line contains comments */
+    hash=(char *)memchr(p,'#',(size_t)(le-p));
+    ce=hash ? hash : le;
+
+    if(c->docs == c->maxdocs) {
+      max=c->maxdocs;
+      c->label=(double *)grow_array(c->label,&max,c->docs+1,sizeof(double));
+      max=c->maxdocs;
+      c->fnum=(long *)grow_array(c->fnum,&max,c->docs+1,sizeof(long));
+      c->doc=(DOC *)grow_array(c->doc,&c->maxdocs,c->docs+1,sizeof(DOC));
+    }
+    d=c->doc+c->docs;
+    d->queryid=0;
+    d->slackid=0;
+    d->costfactor=1;
+    first=1;
+    nfeat=0;
+    for(ts=p;;ts=te) {
+      while((ts<ce) && isspace((unsigned char)*ts)) ts++;
+      if(ts>=ce) break;
+      for(te=ts;(te<ce) && (!isspace((unsigned char)*te));te++);
+
+      if(first) {
+	if(memchr(ts,':',(size_t)(te-ts))) {
+	  perror ("Line must start with label or 0!!!\n"); 
+	  printf("LINE: %.*s\n",(int)(le-p),p);
+	  exit (1); 
+	}
+	if(!scan_double(ts,te,&c->label[c->docs])) 
+	  break;
+	first=0;
+	continue;
+      }
+      if(((te-ts)>4) && (!strncmp(ts,"qid:",4)) 
+	 && (scan_long(ts+4,te,&wnum)==te)) {
+	/* it is the query id */
+	d->queryid=wnum;
+      }
+      else if(((te-ts)>4) && (!strncmp(ts,"sid:",4)) 
+	      && (scan_long(ts+4,te,&wnum)==te)) {
+	/* it is the slack id */
+	if(wnum > 0) 
+	  d->slackid=wnum;
+	else {
+	  perror ("Slack-id must be greater or equal to 1!!!\n"); 
+	  printf("LINE: %.*s\n",(int)(le-p),p);
+	  exit (1); 
+	}
+      }
+      else if(((te-ts)>5) && (!strncmp(ts,"cost:",5)) 
+	      && (scan_double(ts+5,te,&v)==te)) {
+	/* it is the example-dependent cost factor */
+	d->costfactor=v;
+      }
+      else if((q=scan_long(ts,te,&wnum)) && (q<te) && (*q==':')
+	      && (scan_double(q+1,te,&v)==te)) {
+	/* it is a regular feature */
+	if(wnum<=0) { 
+	  perror ("Feature numbers must be larger or equal to 1!!!\n"); 
+	  printf("LINE: %.*s\n",(int)(le-p),p);
+	  exit (1); 
+	}
+	if((nfeat>0) && (c->word[c->words+nfeat-1].wnum >= wnum)) { 
+	  perror ("Features must be in increasing order!!!\n"); 
+	  printf("LINE: %.*s\n",(int)(le-p),p);
+	  exit (1); 
+	}
+	if(wnum > MAXFEATNUM) {
+	  printf("\nMaximum feature number exceeds limit defined in MAXFEATNUM!\n");
+	  printf("LINE: %.*s\n",(int)(le-p),p);
+	  exit(1);
+	}
+	c->word=(WORD *)grow_array(c->word,&c->maxwords,c->words+nfeat+2,
+				   sizeof(WORD));
+	c->word[c->words+nfeat].wnum=wnum;
+	c->word[c->words+nfeat].weight=(FVAL)v;
+	nfeat++;
+	if(wnum > c->totwords) 
+	  c->totwords=wnum;
+      }
+      else {
+	perror ("Cannot parse feature/value pair!!!\n"); 
+	printf("'%.*s' in LINE: %.*s\n",(int)(te-ts),ts,(int)(le-p),p);
+	exit (1); 
+      }
+    }
+    if(first) {
+      printf("\nParsing error in line!\n%.*s\n",(int)(le-p),p);
+      exit(1);
+    }
+    c->word=(WORD *)grow_array(c->word,&c->maxwords,c->words+nfeat+1,
+			       sizeof(WORD));
+    c->word[c->words+nfeat].wnum=0;
+    c->fnum[c->docs]=nfeat+1;
+    c->words+=nfeat+1;
+
+    len=hash ? (le-hash-1) : 0;
+    c->comment=(char *)grow_array(c->comment,&c->maxchars,c->chars+len+1,1);
+    if(len) 
+      memcpy(c->comment+c->chars,hash+1,(size_t)len);
+    c->comment[c->chars+len]=0;
+    c->chars+=len+1;
+    c->docs++;
+  }
+}
+
+void read_documents(char *docfile, DOC ***docs, double **label, 
+		    long int *totwords, long int *totdoc)
+     /* reads the examples in one pass over the mapped file. The file
+	is split into line-aligned chunks that are parsed in parallel.
+	All documents, feature vectors, features and comments are then
+	stored in one allocation each, so they must be released with
+	free_documents instead of free_example. */
+{
+  int fd;
+  struct stat st;
+  char *map,*p;
+  long size,nchunks,i,k,dnum,wpos,cpos;
+  DOC_CHUNK *chunk;
+  DOC *docarena;
+  SVECTOR *vecarena;
+  WORD *wordarena;
+  char *chararena;
 
-  words = (WORD *)my_malloc(sizeof(WORD)*(max_words_doc+10));
   if(verbosity>=1) {
     printf("Reading examples into memory..."); fflush(stdout);
   }
-  dnum=0;
-  (*totwords)=0;
-  while((!feof(docfl)) && fgets(line,(int)ll,docfl)) {
-    if(line[0] == '#') continue;  /* line contains comments */
-    if(!parse_document(line,words,&doc_label,&queryid,&slackid,&costfactor,
-		       &wpos,max_words_doc,&comment)) {
-      printf("\nParsing error in line %ld!\n%s",dnum,line);
-      exit(1);
-    }
-    (*label)[dnum]=doc_label;
-    /* printf("docnum=%ld: Class=%f ",dnum,doc_label); */
-    if(doc_label > 0) dpos++;
-    if (doc_label < 0) dneg++;
-    if (doc_label == 0) dunlab++;
-    if((wpos>1) && ((words[wpos-2]).wnum>(*totwords))) 
-      (*totwords)=(words[wpos-2]).wnum;
-    if((*totwords) > MAXFEATNUM) {
-      printf("\nMaximum feature number exceeds limit defined in MAXFEATNUM!\n");
-      printf("LINE: %s\n",line);
+  if((fd=open(docfile,O_RDONLY)) == -1) {
+    perror(docfile);
+    exit(1);
+  }
+  if(fstat(fd,&st) == -1) {
+    perror(docfile);
+    exit(1);
+  }
+  size=(long)st.st_size;
+  map=NULL;
+  if(size > 0) {
+    map=(char *)mmap(NULL,(size_t)size,PROT_READ,MAP_PRIVATE,fd,0);
+    if(map == MAP_FAILED) {
+      perror(docfile);
       exit(1);
     }
-    (*docs)[dnum] = create_example(dnum,queryid,slackid,costfactor,
-				   create_svector(words,comment,1.0));
-    /* printf("\nNorm=%f\n",((*docs)[dnum]->fvec)->twonorm_sq);  */
-    dnum++;  
-    if(verbosity>=1) {
-      if((dnum % 100) == 0) {
-	printf("%ld..",dnum); fflush(stdout);
-      }
+  }
+  close(fd);
+
+  nchunks=minl(READ_CHUNKS_MAX,size/READ_CHUNK_MIN+1);
+  chunk=(DOC_CHUNK *)my_malloc(sizeof(DOC_CHUNK)*nchunks);
+  memset(chunk,0,sizeof(DOC_CHUNK)*nchunks);
+  p=map;
+  for(k=0;k<nchunks;k++) {
+    chunk[k].start=p;
+    p=map+size*(k+1)/nchunks;
+    if(p<chunk[k].start) 
+      p=chunk[k].start;
+    while((p<map+size) && (p>map) && (*(p-1)!='\n')) 
+      p++;
+    chunk[k].end=p;
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for(k=0;k<nchunks;k++) 
+    parse_chunk(&chunk[k]);
+
+  dnum=0;
+  wpos=0;
+  cpos=0;
+  (*totwords)=0;
+  for(k=0;k<nchunks;k++) {
+    dnum+=chunk[k].docs;
+    wpos+=chunk[k].words;
+    cpos+=chunk[k].chars;
+    (*totwords)=maxl((*totwords),chunk[k].totwords);
+  }
+  (*totdoc)=dnum;
+  (*docs)=(DOC **)my_malloc(sizeof(DOC *)*(dnum+2));
+  (*label)=(double *)my_malloc(sizeof(double)*(dnum+2));
+  docarena=(DOC *)my_malloc(sizeof(DOC)*dnum);
+  vecarena=(SVECTOR *)my_malloc(sizeof(SVECTOR)*dnum);
+  wordarena=(WORD *)my_malloc(sizeof(WORD)*wpos);
+  chararena=(char *)my_malloc(cpos);
+
+  /* turn the counts into the positions of the chunks in the arenas */
+  dnum=0;
+  wpos=0;
+  cpos=0;
+  for(k=0;k<nchunks;k++) {
+    i=chunk[k].docs;   chunk[k].docs=dnum;   dnum+=i;
+    i=chunk[k].words;  chunk[k].words=wpos;  wpos+=i;
+    i=chunk[k].chars;  chunk[k].chars=cpos;  cpos+=i;
+  }
+
+#pragma omp parallel for schedule(dynamic) private(i)
+  for(k=0;k<nchunks;k++) {
+    DOC_CHUNK *c=&chunk[k];
+    long n=((k+1<nchunks) ? chunk[k+1].docs : dnum)-c->docs;
+    WORD *w=wordarena+c->words;
+    char *u=chararena+c->chars;
+
+    memcpy(wordarena+c->words,c->word,
+	   sizeof(WORD)*(((k+1<nchunks) ? chunk[k+1].words : wpos)-c->words));
+    memcpy(chararena+c->chars,c->comment,
+	   ((k+1<nchunks) ? chunk[k+1].chars : cpos)-c->chars);
+    for(i=0;i<n;i++) {
+      DOC *d=docarena+c->docs+i;
+      SVECTOR *f=vecarena+c->docs+i;
+      (*d)=c->doc[i];
+      d->docnum=c->docs+i;
+      d->fvec=f;
+      f->words=w;
+      f->twonorm_sq=sprod_ss(f,f);
+      f->userdefined=u;
+      f->kernel_id=0;
+      f->next=NULL;
+      f->factor=1.0;
+      (*docs)[c->docs+i]=d;
+      (*label)[c->docs+i]=c->label[i];
+      w+=c->fnum[i];
+      u+=strlen(u)+1;
     }
-  } 
+    free(c->doc);
+    free(c->label);
+    free(c->fnum);
+    free(c->word);
+    free(c->comment);
+  }
+  free(chunk);
+  if(map) 
+    munmap(map,(size_t)size);
 
-  fclose(docfl);
-  free(line);
-  free(words);
   if(verbosity>=1) {
     fprintf(stdout, "OK. (%ld examples read)\n", dnum);
   }
-  (*totdoc)=dnum;
+}
+
+void free_documents(DOC **docs, long totdoc)
+     /* releases the examples read by read_documents */
+{
+  if(totdoc > 0) {
+    free(docs[0]->fvec->words);
+    free(docs[0]->fvec->userdefined);
+    free(docs[0]->fvec);
+    free(docs[0]);
+  }
+  free(docs);
 }
 
 int parse_document(char *line, WORD *words, double *label,
@@ -975,6 +2286,18 @@ void *my_malloc(size_t size)
   return(ptr);
 }
 
+void *my_malloc_aligned(size_t size)
+     /* like my_malloc, but aligned to a cache line */
+{
+  void *ptr;
+  if(size<=0) size=1; /* for AIX compatibility */
+  if(posix_memalign(&ptr,64,size)) {
+    perror ("Out of memory!\n");
+    exit (1);
+  }
+  return(ptr);
+}
+
 void copyright_notice(void)
 {
   printf("\nCopyright: Thorsten Joachims, thorsten@joachims.org\n\n");
@@ -33,6 +33,26 @@
 # define CFLOAT  float       /* the type of float to use for caching */
                              /* kernel evaluations. Using float saves */
                              /* us some memory, but you can use double, too */
+
+/* Element type of the kernel cache buffer. Rows are converted from and
+   to CFLOAT when they enter and leave the cache, so 16 bit elements
+   double the number of rows the cache holds at the cost of precision.
+   Define KERNEL_CACHE_FP16 (IEEE half, needs _Float16 support) or
+   KERNEL_CACHE_BF16 (bfloat16) to select them. */
+# if defined(KERNEL_CACHE_FP16)
+#  define KFLOAT  _Float16
+#  define KFLOAT_LOAD(x)   ((CFLOAT)(x))
+#  define KFLOAT_STORE(x)  ((_Float16)(x))
+# elif defined(KERNEL_CACHE_BF16)
+#  define KFLOAT  unsigned short
+#  define KFLOAT_LOAD(x)   bf16_to_float(x)
+#  define KFLOAT_STORE(x)  float_to_bf16(x)
+# else
+#  define KFLOAT  CFLOAT
+#  define KFLOAT_LOAD(x)   ((CFLOAT)(x))
+#  define KFLOAT_STORE(x)  ((CFLOAT)(x))
+# endif
+
 # define FNUM    long        /* the type used for storing feature ids */
 # define FVAL    float       /* the type used for storing feature values */
 # define MAXFEATNUM 99999999 /* maximum feature number (must be in
@@ -42,6 +62,17 @@
 # define POLY    1           /* polynoial kernel type */
 # define RBF     2           /* rbf kernel type */
 # define SIGMOID 3           /* sigmoid kernel type */
+# define CUSTOM  4           /* user defined kernel type (kernel.h) */
+# define PRECOMPUTED 5       /* kernel values read from a Gram matrix file */
+# define RFF     6           /* rbf kernel approximated by random Fourier
+				features, trained as linear kernel */
+
+# define GRAM_MAGIC "SVMGRAM1" /* header of Gram matrix files, followed
+				  by the 64 bit number of rows n and
+				  n*n row-major float values */
+
+# define BINARY_MODEL_MAGIC   "SVMLBINM" /* header of binary model files */
+# define BINARY_MODEL_VERSION 1
 
 # define CLASSIFICATION 1    /* train classification model */
 # define REGRESSION     2    /* train regression model */
@@ -49,6 +80,35 @@
 # define OPTIMIZATION   4    /* train on general set of constraints */
 
 # define MAXSHRINK     50000    /* maximum number of shrinking rounds */
+# define SMO_TAU       1E-12    /* lower bound on the curvature of the
+				   objective along an SMO pair */
+# define KERNEL_PAR_MIN  512    /* minimum number of kernel values to
+				   compute in parallel with OpenMP */
+# define CLASSIFY_BLOCK   32    /* examples scored together against
+				   each support vector */
+# define REACTIVATE_BLOCK 64    /* kernel rows computed together when
+				   reactivating shrunk variables */
+# define REACTIVATE_BLOCK_MAX (1<<22) /* maximum number of kernel values
+				   in such a block */
+# define ACCU_DENSE_RATIO 16    /* a sparse accumulator is treated as dense
+				   when more than 1/16 of it is touched */
+# define ACCU_MERGE_MAX  512    /* maximum number of nonzeros for which
+				   dot products merge with the sparse
+				   accumulator instead of reading it densely */
+# define ACCU_MERGE_MIN_N (1<<19) /* minimum size of an accumulator for
+				   merging, smaller ones stay in cache */
+# define CLASSIFY_TILE_MAX (1<<20) /* maximum number of dense feature
+				   values per block of examples */
+# define READ_CHUNK_MIN (1<<20) /* bytes of training data per chunk
+				   parsed in parallel */
+# define READ_CHUNKS_MAX 4096   /* maximum number of these chunks */
+# define COMPILE_DENSE_MIN 0.9  /* fraction of nonzero features, from
+				   which compiled support vectors are
+				   stored as dense rows */
+# define RFF_TABLE_MAX (1<<24)  /* maximum number of projection values
+				   kept for random Fourier features, the
+				   columns of higher features are drawn
+				   again for every example */
 
 typedef struct word {
   FNUM    wnum;	               /* word number */
@@ -118,6 +178,19 @@ typedef struct doc {
 				  factor of -1. */
 } DOC;
 
+typedef struct sparse_accu {
+  double *vec;        /* dense values, zero except at the touched indices */
+  long   n;           /* highest index of vec */
+  long   *touched;    /* indices that were zero when added to, may repeat */
+  long   touchednum;
+  long   maxtouched;  /* with more touched indices the accumulator is
+			 cleared and read as a dense vector */
+  long   *mergewnum;  /* indices and values of the nonzeros by */
+  double *mergeval;   /* increasing index for sparse dot products,
+			 valid after sparse_accu_compact */
+  long   mergenum;    /* -1, if dot products use the dense vector */
+} SPARSE_ACCU;
+
 typedef struct learn_parm {
   long   type;                 /* selects between regression and
 				  classification */
@@ -137,7 +210,16 @@ typedef struct learn_parm {
   long   svm_maxqpsize;        /* size q of working set */
   long   svm_newvarsinqp;      /* new variables to enter the working set 
 				  in each iteration */
+  long   svm_smo;              /* if nonzero, optimize working sets of two
+				  variables analytically (SMO) instead of
+				  with the QP-solver */
+  long   svm_dcd;              /* if nonzero, train linear classification
+				  models by dual coordinate descent on the
+				  weight vector */
   long   kernel_cache_size;    /* size of kernel cache in megabytes */
+  long   shrink_history_size;  /* size of the log of alphas kept for
+				  shrinking with non-linear kernels in
+				  megabytes */
   double epsilon_crit;         /* tolerable error for distances used 
 				  in stopping criterion */
   double epsilon_shrink;       /* how much a multiplier should be above 
@@ -154,7 +236,8 @@ typedef struct learn_parm {
 				  shrinking. WARNING: This might lead to 
 				  sub-optimal solutions! */
   long   compute_loo;          /* if nonzero, computes leave-one-out
-				  estimates */
+				  estimates; 2 computes them in parallel
+				  threads */
   double rho;                  /* parameter in xi/alpha-estimates and for
 				  pruning leave-one-out range [1..2] */
   long   xa_depth;             /* parameter in xi/alpha-estimates upper
@@ -182,14 +265,61 @@ typedef struct learn_parm {
 } LEARN_PARM;
 
 typedef struct kernel_parm {
-  long    kernel_type;   /* 0=linear, 1=poly, 2=rbf, 3=sigmoid, 4=custom */
+  long    kernel_type;   /* 0=linear, 1=poly, 2=rbf, 3=sigmoid, 4=custom,
+			    5=precomputed */
   long    poly_degree;
   double  rbf_gamma;
   double  coef_lin;
   double  coef_const;
   char    custom[50];    /* for user supplied kernel */
+  char    gram_file[200];/* Gram matrix file for precomputed kernel */
+  long    rff_dim;       /* number of random Fourier features replacing
+			    the rbf kernel, 0 for the exact kernel */
+  long    rff_seed;      /* seed of their random projection */
+  long    rff_words;     /* highest feature number of the projection */
+
+  /* the following values are not written to file */
+  float   *gram;         /* mapped Gram matrix, indexed by docnum */
+  long    gram_n;        /* number of rows of the Gram matrix */
+  size_t  gram_size;     /* size of the mapping in bytes */
+  float   *rff_proj;     /* columns of the random projection for the
+			    features 1..rff_projwords, rff_dim/2 values
+			    each */
+  long    rff_projwords;
 } KERNEL_PARM;
 
+typedef struct compiled_model {
+  long    sv_num;       /* number of distinct support vectors */
+  long    totwords;     /* number of features */
+  long    dense;        /* rows stored densely with stride rowlen */
+  long    rowlen;       /* length of a dense row, a multiple of 16 */
+  long    *rowstart;    /* sparse row i is wnum/weight[rowstart[i]..] */
+  FNUM    *wnum;        /* feature numbers of all sparse rows */
+  FVAL    *weight;      /* feature values of all rows */
+  double  *alpha;       /* summed alpha*factor of identical vectors */
+  double  *twonorm_sq;  /* squared length of each row */
+  void    *map;         /* mapped binary model file the arrays point */
+  size_t  map_size;     /* into, or NULL if they are allocated */
+} COMPILED_MODEL;
+
+typedef struct binary_model_header {
+  char    magic[8];     /* BINARY_MODEL_MAGIC */
+  int     version;      /* BINARY_MODEL_VERSION */
+  int     byteorder;    /* 0x01020304 in the byte order of the writer */
+  int     fnum_size,fval_size,long_size; /* sizes of the array types */
+  int     lin_weights;  /* file holds the weight vector of a linear
+			   model */
+  long long kernel_type,poly_degree;
+  double  rbf_gamma,coef_lin,coef_const;
+  char    custom[56];
+  long long totwords,totdoc,at_upper_bound;
+  double  b;
+  long long sv_num,dense,rowlen,nnz; /* as in COMPILED_MODEL */
+  long long alpha_pos,twonorm_sq_pos,rowstart_pos,wnum_pos,weight_pos,
+            lin_weights_pos; /* file offsets of the arrays, each aligned
+				to 64 bytes */
+} BINARY_MODEL_HEADER;
+
 typedef struct model {
   long    sv_num;	
   long    at_upper_bound;
@@ -208,6 +338,8 @@ typedef struct model {
 						 folding */
   double  maxdiff;                            /* precision, up to which this 
 						 model is accurate */
+  COMPILED_MODEL *compiled;                   /* flat copy of the support
+						 vectors for classification */
 } MODEL;
 
 typedef struct quadratic_program {
@@ -222,17 +354,30 @@ typedef struct quadratic_program {
 
 typedef struct kernel_cache {
   long   *index;  /* cache some kernel evalutations */
-  CFLOAT *buffer; /* to improve speed */
+  KFLOAT *buffer; /* to improve speed */
   long   *invindex;
-  long   *active2totdoc;
-  long   *totdoc2active;
-  long   *lru;
+  long   *active2totdoc; /* column -> docnum, -1 for removed columns */
+  long   *totdoc2active; /* docnum -> column, -1 if not cached */
+  long   *lru_prev;   /* doubly linked list of the occupied rows, */
+  long   *lru_next;   /* from least to most recently used */
+  long   lru_head;
+  long   lru_tail;
+  long   *free_slots; /* stack of unoccupied rows */
+  long   free_num;
   long   *occu;
   long   elems;
   long   max_elems;
-  long   time;
-  long   activenum;
+  long   activenum;   /* number of live columns */
+  long   rowlen;      /* length of a row, including removed columns */
   long   buffsize;
+  long   hits;        /* statistics */
+  long   misses;
+  long   evictions;
+  long   readonly;    /* if nonzero, rows are only looked up, never
+			 added, evicted, or reordered, so that several
+			 threads can share the cache */
+  double *diag;       /* K(i,i) for all documents, NULL until
+			 kernel_cache_diagonal computes it */
 } KERNEL_CACHE;
 
 
@@ -240,6 +385,7 @@ typedef struct timing_profile {
   long   time_kernel;
   long   time_opti;
   long   time_shrink;
+  long   time_reactivate;
   long   time_update;
   long   time_model;
   long   time_check;
@@ -250,16 +396,55 @@ typedef struct shrink_state {
   long   *active;
   long   *inactive_since;
   long   deactnum;
-  double **a_history;  /* for shrinking with non-linear kernel */
   long   maxhistory;
+  double *a_snapshot;  /* for shrinking with non-linear kernel: alphas
+			  at the last shrinking step */
+  long   firsthistory; /* oldest step that can be restored from the log */
+  long   *undo_start;  /* undo_start[t] is the first log entry that
+			  restores the alphas of step t-1 from step t */
+  long   *undo_index;  /* log of the alphas that changed between steps */
+  double *undo_a;      /* and their values at the earlier step */
+  long   undonum;      /* number of entries in the log */
+  long   undomax;      /* number of entries allocated */
   double *last_a;      /* for shrinking with linear kernel */
   double *last_lin;    /* for shrinking with linear kernel */
 } SHRINK_STATE;
 
+typedef struct qp_solver QP_SOLVER; /* defined by the QP-solver module */
+
+typedef struct solver_context {
+  /* All state a training run keeps besides its arguments, so that
+     several runs can take place at the same time in one process. The
+     only globals left are verbosity, which is only read while
+     training, and kernel_cache_statistic, which only counts the
+     kernel evaluations of the whole process. */
+  QP_SOLVER *qp_solver;      /* adaptive parameters and buffers of the 
+				QP-solver */
+  double switchsens;         /* state of the transductive learner */
+  double switchsensorg;
+  long   switchnum;
+  long   kernel_evals;       /* kernel evaluations of this run */
+} SOLVER_CONTEXT;
+
 double classify_example(MODEL *, DOC *);
 double classify_example_linear(MODEL *, DOC *);
+double classify_example_rff(MODEL *, DOC *);
+void   classify_examples(MODEL *, DOC **, long, double *);
+double compiled_kernel(KERNEL_PARM *, double, double, double);
+double compiled_sprod(COMPILED_MODEL *, long, SVECTOR *);
 double kernel(KERNEL_PARM *, DOC *, DOC *); 
+double kernel_nostat(KERNEL_PARM *, DOC *, DOC *, long *); 
 double single_kernel(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
+double single_kernel_nostat(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
+double gram_lookup(KERNEL_PARM *, long, long);
+float  *gram_row(KERNEL_PARM *, long);
+void   gram_open(KERNEL_PARM *);
+void   gram_close(KERNEL_PARM *);
+void   rff_init(KERNEL_PARM *);
+void   rff_cleanup(KERNEL_PARM *);
+SVECTOR *rff_map_svector(KERNEL_PARM *, SVECTOR *);
+void   rff_map_documents(KERNEL_PARM *, DOC **, long);
+double rff_sprod(KERNEL_PARM *, double *, SVECTOR *);
 double custom_kernel(KERNEL_PARM *, SVECTOR *, SVECTOR *); 
 SVECTOR *create_svector(WORD *, char *, double);
 SVECTOR *copy_svector(SVECTOR *);
@@ -275,13 +460,25 @@ double model_length_s(MODEL *, KERNEL_PARM *);
 void   clear_vector_n(double *, long);
 void   add_vector_ns(double *, SVECTOR *, double);
 double sprod_ns(double *, SVECTOR *);
+SPARSE_ACCU *sparse_accu_init(long);
+void   sparse_accu_free(SPARSE_ACCU *);
+void   sparse_accu_clear(SPARSE_ACCU *);
+void   sparse_accu_add(SPARSE_ACCU *, SVECTOR *, double);
+void   sparse_accu_compact(SPARSE_ACCU *);
+double sparse_accu_sprod(SPARSE_ACCU *, SVECTOR *);
 void   add_weight_vector_to_linear_model(MODEL *);
+void   compile_model(MODEL *);
+void   free_compiled_model(COMPILED_MODEL *);
 DOC    *create_example(long, long, long, double, SVECTOR *);
 void   free_example(DOC *, long);
 MODEL  *read_model(char *);
+void   write_compiled_svs(FILE *, MODEL *);
+void   write_binary_model(char *, MODEL *);
+MODEL  *read_binary_model(char *);
 MODEL  *copy_model(MODEL *);
 void   free_model(MODEL *, int);
 void   read_documents(char *, DOC ***, double **, long *, long *);
+void   free_documents(DOC **, long);
 int    parse_document(char *, WORD *, double *, long *, long *, double *, long *, long, char **);
 double *read_alphas(char *,long);
 void   nol_ll(char *, long *, long *, long *);
@@ -290,11 +487,31 @@ long   maxl(long, long);
 long   get_runtime(void);
 int    space_or_null(int);
 void   *my_malloc(size_t); 
+void   *my_malloc_aligned(size_t);
 void   copyright_notice(void);
 # ifdef _MSC_VER
    int isnan(double);
 # endif
 
+# ifdef KERNEL_CACHE_BF16
+static inline float bf16_to_float(unsigned short h)
+{
+  unsigned int bits=(unsigned int)h << 16;
+  float f;
+  memcpy(&f,&bits,sizeof(f));
+  return(f);
+}
+
+static inline unsigned short float_to_bf16(float f)
+     /* round to nearest even, kernel values are never NaN */
+{
+  unsigned int bits;
+  memcpy(&bits,&f,sizeof(bits));
+  bits+=0x7fff+((bits >> 16) & 1);
+  return((unsigned short)(bits >> 16));
+}
+# endif
+
 extern long   verbosity;              /* verbosity level (0-4) */
 extern long   kernel_cache_statistic;
 
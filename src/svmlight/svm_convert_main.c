@@ -0,0 +1,79 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_convert_main.c                                                */
+/*                                                                     */
+/*   Command line tool converting model files between the text and     */
+/*   the binary format.                                                */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_common.h"
+# include "svm_learn.h"
+
+char inmodelfile[200];       /* model to convert, in either format */
+char outmodelfile[200];      /* converted model */
+
+void   read_input_parameters(int, char **, char *, char *, long *, long *);
+void   print_help();
+
+int main (int argc, char* argv[])
+{  
+  MODEL *model;
+  long binary;
+
+  read_input_parameters(argc,argv,inmodelfile,outmodelfile,&verbosity,
+			&binary);
+  model=read_model(inmodelfile);
+  if(binary)
+    write_binary_model(outmodelfile,model);
+  else
+    write_model(outmodelfile,model);
+  free_model(model,1);
+
+  return(0);
+}
+
+void read_input_parameters(int argc,char *argv[],char *inmodelfile,
+			   char *outmodelfile,long *verbosity,long *binary)
+{
+  long i;
+  
+  /* set default */
+  (*verbosity)=1;
+  (*binary)=1;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1]) 
+      { 
+      case '?': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 't': (*binary)=0; break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (inmodelfile, argv[i]);
+  strcpy (outmodelfile, argv[i+1]);
+}
+
+void print_help()
+{
+  printf("\nSVM-light %s: Support Vector Machine, model conversion     %s\n",VERSION,VERSION_DATE);
+  copyright_notice();
+  printf("   usage: svm_convert [options] model_file output_file\n\n");
+  printf("Arguments:\n");
+  printf("         model_file  -> model in the text or the binary format\n");
+  printf("         output_file -> converted model\n");
+  printf("Options:\n");
+  printf("         -?          -> this help\n");
+  printf("         -v [0..3]   -> verbosity level (default 1)\n");
+  printf("         -t          -> write the text format instead of the binary\n");
+  printf("                        format. Identical support vectors of the\n");
+  printf("                        model are merged either way.\n\n");
+}
@@ -0,0 +1,145 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_gram_main.c                                                   */
+/*                                                                     */
+/*   Command line tool computing the Gram matrix of a training set     */
+/*   for the precomputed kernel type of the learning module.           */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_common.h"
+
+# define GRAM_BLOCK 64       /* rows computed in parallel per write */
+
+char docfile[200];           /* file with training examples */
+char gramfile[200];          /* file for the resulting matrix */
+
+void   read_input_parameters(int, char **, char *, char *, long *, 
+			     KERNEL_PARM *);
+void   print_help();
+
+int main (int argc, char* argv[])
+{  
+  DOC **docs;  /* training examples */
+  long totwords,totdoc,i,j,rows,evals=0;
+  long long n;
+  double *target;
+  float *block;
+  FILE *gramfl;
+  KERNEL_PARM kernel_parm;
+
+  read_input_parameters(argc,argv,docfile,gramfile,&verbosity,&kernel_parm);
+  read_documents(docfile,&docs,&target,&totwords,&totdoc);
+
+  if ((gramfl = fopen (gramfile, "wb")) == NULL)
+  { perror (gramfile); exit (1); }
+
+  n=totdoc;
+  fwrite(GRAM_MAGIC,1,strlen(GRAM_MAGIC),gramfl);
+  fwrite(&n,sizeof(n),1,gramfl);
+
+  if(verbosity>=1) {
+    printf("Computing %ldx%ld Gram matrix...",totdoc,totdoc); fflush(stdout);
+  }
+
+  block=(float *)my_malloc(sizeof(float)*GRAM_BLOCK*totdoc);
+  for(i=0;i<totdoc;i+=GRAM_BLOCK) {
+    rows=minl(GRAM_BLOCK,totdoc-i);
+#pragma omp parallel for schedule(static) reduction(+:evals)
+    for(j=0;j<rows*totdoc;j++) {
+      block[j]=(float)kernel_nostat(&kernel_parm,docs[i+j/totdoc],
+				    docs[j%totdoc],&evals);
+    }
+    if(fwrite(block,sizeof(float),rows*totdoc,gramfl) != (size_t)(rows*totdoc)) {
+      perror(gramfile); 
+      exit(1);
+    }
+  }
+  fclose(gramfl);
+
+  if(verbosity>=1) {
+    printf("done\n");
+    printf("Number of kernel evaluations: %ld\n",evals);
+  }
+
+  free(block);
+  free_documents(docs,totdoc);
+  free(target);
+
+  return(0);
+}
+
+void read_input_parameters(int argc,char *argv[],char *docfile,char *gramfile,
+			   long *verbosity,KERNEL_PARM *kernel_parm)
+{
+  long i;
+  
+  /* set default */
+  strcpy (gramfile, "svm_gram");
+  (*verbosity)=1;
+  kernel_parm->kernel_type=0;
+  kernel_parm->poly_degree=3;
+  kernel_parm->rbf_gamma=1.0;
+  kernel_parm->coef_lin=1;
+  kernel_parm->coef_const=1;
+  strcpy(kernel_parm->custom,"empty");
+  strcpy(kernel_parm->gram_file,"");
+  kernel_parm->gram=NULL;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1]) 
+      { 
+      case '?': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 't': i++; kernel_parm->kernel_type=atol(argv[i]); break;
+      case 'd': i++; kernel_parm->poly_degree=atol(argv[i]); break;
+      case 'g': i++; kernel_parm->rbf_gamma=atof(argv[i]); break;
+      case 's': i++; kernel_parm->coef_lin=atof(argv[i]); break;
+      case 'r': i++; kernel_parm->coef_const=atof(argv[i]); break;
+      case 'u': i++; strcpy(kernel_parm->custom,argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if(i>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (docfile, argv[i]);
+  if((i+1)<argc) {
+    strcpy (gramfile, argv[i+1]);
+  }
+  if((kernel_parm->kernel_type < LINEAR) 
+     || (kernel_parm->kernel_type >= PRECOMPUTED)) {
+    printf("\nKernel type must be in [0..4]!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help()
+{
+  printf("\nSVM-light %s: Support Vector Machine, Gram matrix tool     %s\n",VERSION,VERSION_DATE);
+  copyright_notice();
+  printf("   usage: svm_gram [options] example_file gram_file\n\n");
+  printf("Arguments:\n");
+  printf("         example_file-> file with training data\n");
+  printf("         gram_file   -> file to store the Gram matrix in, to be\n");
+  printf("                        used with svm_learn -t 5 -G gram_file\n");
+  printf("Options:\n");
+  printf("         -?          -> this help\n");
+  printf("         -v [0..3]   -> verbosity level (default 1)\n");
+  printf("         -t int      -> type of kernel function:\n");
+  printf("                        0: linear (default)\n");
+  printf("                        1: polynomial (s a*b+c)^d\n");
+  printf("                        2: radial basis function exp(-gamma ||a-b||^2)\n");
+  printf("                        3: sigmoid tanh(s a*b + c)\n");
+  printf("                        4: user defined kernel from kernel.h\n");
+  printf("         -d int      -> parameter d in polynomial kernel\n");
+  printf("         -g float    -> parameter gamma in rbf kernel\n");
+  printf("         -s float    -> parameter s in sigmoid/poly kernel\n");
+  printf("         -r float    -> parameter c in sigmoid/poly kernel\n");
+  printf("         -u string   -> parameter of user defined kernel\n\n");
+}
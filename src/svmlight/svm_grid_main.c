@@ -0,0 +1,556 @@
+/***********************************************************************/
+/*                                                                     */
+/*   svm_grid_main.c                                                   */
+/*                                                                     */
+/*   Command line tool training SVM classifiers for a grid of values   */
+/*   of C, the kernel parameter gamma and the cost ratio j, and        */
+/*   reporting their error on a validation set. For the rbf kernel,    */
+/*   the grid can also compare the exact kernel with approximations    */
+/*   by different numbers of random Fourier features.                  */
+/*                                                                     */
+/***********************************************************************/
+
+# include "svm_common.h"
+# include "svm_learn.h"
+
+# define GRID_MAX 64         /* maximum number of values per parameter */
+
+typedef struct grid_point {
+  double svm_c;
+  double rbf_gamma;
+  double svm_costratio;
+  long   rff_dim;            /* random Fourier features, 0 for exact */
+  long   trained;            /* 0 if the chain was stopped before */
+  long   sv_num;
+  double error,recall,precision; /* on the validation set */
+  double rate;               /* validation examples per cpu-second */
+  MODEL  *model;             /* kept until the rate is measured */
+} GRID_POINT;
+
+char docfile[200];           /* file with training examples */
+char validfile[200];         /* file with validation examples */
+long keepmodels;             /* keep the models to measure their speed */
+
+void   train_chain(DOC **, double *, long, long, DOC **, double *, long,
+		   LEARN_PARM *, KERNEL_PARM *, KERNEL_CACHE *, long,
+		   GRID_POINT *, long, long, long);
+void   evaluate_model(MODEL *, DOC **, double *, long, GRID_POINT *);
+void   measure_rate(GRID_POINT *, DOC **, long);
+long   parse_grid_list(char *, double *, long);
+int    compare_double(const void *, const void *);
+void   read_input_parameters(int, char **, char *, char *, long *,
+			     LEARN_PARM *, KERNEL_PARM *, double *, long *,
+			     double *, long *, double *, long *, double *,
+			     long *, long *, long *);
+void   print_help();
+
+int main (int argc, char* argv[])
+{
+  DOC **docs,**vdocs;  /* training and validation examples */
+  DOC ***gdocs;        /* training examples mapped for each gamma */
+  long totwords,totdoc,vtotwords,vtotdoc,i,g,j,k,d,chain,best;
+  long cnum,gnum,jnum,dnum,patience,warmstart,grid_verbosity;
+  long first,rffgrid;
+  double *target,*vtarget;
+  double cvals[GRID_MAX],gvals[GRID_MAX],jvals[GRID_MAX],dvals[GRID_MAX];
+  KERNEL_CACHE **kernel_cache;
+  LEARN_PARM learn_parm;
+  KERNEL_PARM kernel_parm,*gkernel;
+  GRID_POINT *grid;
+
+  read_input_parameters(argc,argv,docfile,validfile,&grid_verbosity,
+			&learn_parm,&kernel_parm,cvals,&cnum,gvals,&gnum,
+			jvals,&jnum,dvals,&dnum,&patience,&warmstart);
+  rffgrid=((dnum > 1) || (dvals[0] > 0));
+  keepmodels=rffgrid;
+  verbosity=grid_verbosity;
+  read_documents(docfile,&docs,&target,&totwords,&totdoc);
+  read_documents(validfile,&vdocs,&vtarget,&vtotwords,&vtotdoc);
+  /* the output of the single training runs only with -v 2 and higher */
+  verbosity=maxl(grid_verbosity-1,0);
+
+  /* Points are ordered by the number of random Fourier features,
+     then by gamma, then by j, then by C. The points with equal
+     features, gamma and j form a chain, which is trained in the
+     order of increasing C. With -w 1 each run starts from the alphas
+     of the one before. */
+  grid=(GRID_POINT *)my_malloc(sizeof(GRID_POINT)*dnum*gnum*jnum*cnum);
+  for(d=0;d<dnum;d++)
+    for(g=0;g<gnum;g++)
+      for(j=0;j<jnum;j++)
+	for(k=0;k<cnum;k++) {
+	  i=((d*gnum+g)*jnum+j)*cnum+k;
+	  grid[i].svm_c=cvals[k];
+	  grid[i].rbf_gamma=gvals[g];
+	  grid[i].svm_costratio=jvals[j];
+	  grid[i].rff_dim=(long)dvals[d];
+	  grid[i].trained=0;
+	  grid[i].model=NULL;
+	}
+
+  kernel_cache=(KERNEL_CACHE **)my_malloc(sizeof(KERNEL_CACHE *)*gnum);
+  gkernel=(KERNEL_PARM *)my_malloc(sizeof(KERNEL_PARM)*gnum);
+  gdocs=(DOC ***)my_malloc(sizeof(DOC **)*gnum);
+
+  /* The numbers of features are trained one after the other, since
+     the mapped examples of all values of gamma are kept in memory. */
+  for(d=0;d<dnum;d++) {
+    first=d*gnum*jnum*cnum;
+
+    /* One kernel cache for each gamma. The first chain of a gamma
+       fills it, all other chains of that gamma only read from it, so
+       that they can run at the same time. With random Fourier
+       features, the first chain maps the examples instead, and all
+       chains are trained with the linear kernel. */
+#pragma omp parallel for schedule(dynamic) private(i)
+    for(g=0;g<gnum;g++) {
+      kernel_cache[g]=NULL;
+      gkernel[g]=kernel_parm;
+      gkernel[g].rbf_gamma=gvals[g];
+      gkernel[g].rff_dim=(long)dvals[d];
+      gdocs[g]=docs;
+      if(gkernel[g].rff_dim) {
+	gkernel[g].rff_words=totwords;
+	rff_init(&gkernel[g]);
+	gdocs[g]=(DOC **)my_malloc(sizeof(DOC *)*totdoc);
+	for(i=0;i<totdoc;i++) 
+	  gdocs[g][i]=create_example(docs[i]->docnum,docs[i]->queryid,
+				     docs[i]->slackid,docs[i]->costfactor,
+				     rff_map_svector(&gkernel[g],
+						     docs[i]->fvec));
+      }
+      else if(kernel_parm.kernel_type != LINEAR)
+	kernel_cache[g]=kernel_cache_init(totdoc,learn_parm.kernel_cache_size);
+      train_chain(gdocs[g],target,totdoc,totwords,vdocs,vtarget,vtotdoc,
+		  &learn_parm,&gkernel[g],kernel_cache[g],0,
+		  &grid[first+g*jnum*cnum],cnum,patience,warmstart);
+    }
+
+#pragma omp parallel for schedule(dynamic) private(g,j)
+    for(chain=0;chain<gnum*jnum;chain++) {
+      g=chain/jnum;
+      j=chain%jnum;
+      if(j == 0) continue;   /* trained above */
+      train_chain(gdocs[g],target,totdoc,totwords,vdocs,vtarget,vtotdoc,
+		  &learn_parm,&gkernel[g],kernel_cache[g],1,
+		  &grid[first+chain*cnum],cnum,patience,warmstart);
+    }
+
+    /* Classification speed is measured with nothing else running,
+       and from the original validation examples, so that the rate of
+       the approximation includes mapping them. */
+    for(i=first;i<first+gnum*jnum*cnum;i++) {
+      if(grid[i].model) {
+	measure_rate(&grid[i],vdocs,vtotdoc);
+	free_model(grid[i].model,0);
+	grid[i].model=NULL;
+      }
+    }
+
+    for(g=0;g<gnum;g++) {
+      if(kernel_cache[g])
+	kernel_cache_cleanup(kernel_cache[g]);
+      if(gkernel[g].rff_dim) {
+	for(i=0;i<totdoc;i++) 
+	  free_example(gdocs[g][i],1);
+	free(gdocs[g]);
+	rff_cleanup(&gkernel[g]);
+      }
+    }
+  }
+
+  verbosity=grid_verbosity;
+  best=-1;
+  if(verbosity>=1) {
+    printf("%12s %12s %12s ","C","gamma","j");
+    if(rffgrid) 
+      printf("%8s ","D");
+    printf("%8s %8s %8s %8s","SV","error","recall","prec");
+    if(rffgrid) 
+      printf(" %10s","ex/cpu-s");
+    printf("\n");
+  }
+  for(i=0;i<dnum*gnum*jnum*cnum;i++) {
+    if(grid[i].trained && ((best < 0) || (grid[i].error < grid[best].error)))
+      best=i;
+    if(verbosity>=1) {
+      printf("%12.6g %12.6g %12.6g ",grid[i].svm_c,grid[i].rbf_gamma,
+	     grid[i].svm_costratio);
+      if(rffgrid) {
+	if(grid[i].rff_dim) 
+	  printf("%8ld ",grid[i].rff_dim);
+	else
+	  printf("%8s ","exact");
+      }
+      if(grid[i].trained) {
+	printf("%8ld %7.2f%% %7.2f%% %7.2f%%",grid[i].sv_num,
+	       grid[i].error,grid[i].recall,grid[i].precision);
+	if(rffgrid) 
+	  printf(" %10.0f",grid[i].rate);
+	printf("\n");
+      }
+      else
+	printf("%8s\n","stopped");
+    }
+  }
+  printf("Best: C=%.6g gamma=%.6g j=%.6g",grid[best].svm_c,
+	 grid[best].rbf_gamma,grid[best].svm_costratio);
+  if(grid[best].rff_dim) 
+    printf(" D=%ld",grid[best].rff_dim);
+  printf(" error=%.2f%%\n",grid[best].error);
+
+  free(kernel_cache);
+  free(gkernel);
+  free(gdocs);
+  free(grid);
+  free_documents(docs,totdoc);
+  free_documents(vdocs,vtotdoc);
+  free(target);
+  free(vtarget);
+
+  return(0);
+}
+
+void train_chain(DOC **docs, double *target, long totdoc, long totwords,
+		 DOC **vdocs, double *vtarget, long vtotdoc,
+		 LEARN_PARM *learn_parm, KERNEL_PARM *kernel_parm,
+		 KERNEL_CACHE *kernel_cache, long readonly,
+		 GRID_POINT *point, long cnum, long patience, long warmstart)
+     /* Trains the cnum points of one chain in the order of increasing
+	C. If warmstart is set, each run starts from the alphas of the
+	one before, otherwise from zero. If readonly is set, the kernel
+	cache is only read, so that it can be shared with other chains
+	running at the same time. The chain is stopped when the
+	validation error did not improve for patience points in a row.
+	If keepmodels is set, the trained models are left in the points.
+	With random Fourier features, docs are the mapped examples, and
+	the models classify the original ones. */
+{
+  long i,k,noimprove=0;
+  double *alpha=NULL,besterror=101;
+  LEARN_PARM chain_parm;
+  KERNEL_PARM chain_kernel;
+  KERNEL_CACHE cache_view;
+  MODEL *model;
+
+  chain_kernel=(*kernel_parm);
+  chain_kernel.rbf_gamma=point[0].rbf_gamma;
+  if(chain_kernel.rff_dim) {
+    chain_kernel.kernel_type=LINEAR;
+    totwords=chain_kernel.rff_dim;
+  }
+  if(kernel_cache && readonly) {
+    cache_view=(*kernel_cache);
+    cache_view.readonly=1;
+    kernel_cache=&cache_view;
+  }
+  if(warmstart) {
+    alpha=(double *)my_malloc(sizeof(double)*totdoc);
+    for(i=0;i<totdoc;i++)
+      alpha[i]=0;
+  }
+
+  for(k=0;k<cnum;k++) {
+    chain_parm=(*learn_parm);
+    chain_parm.svm_c=point[k].svm_c;
+    chain_parm.svm_costratio=point[k].svm_costratio;
+    model=(MODEL *)my_malloc(sizeof(MODEL));
+    svm_learn_classification(docs,target,totdoc,totwords,&chain_parm,
+			     &chain_kernel,kernel_cache,model,alpha);
+    if(chain_kernel.rff_dim) 
+      model->kernel_parm.kernel_type=RFF;
+    evaluate_model(model,vdocs,vtarget,vtotdoc,&point[k]);
+    if(keepmodels) 
+      point[k].model=model;
+    else
+      free_model(model,0);
+
+    if(point[k].error < besterror) {
+      besterror=point[k].error;
+      noimprove=0;
+    }
+    else if((patience > 0) && (++noimprove >= patience)) {
+      break;
+    }
+  }
+  if(alpha)
+    free(alpha);
+}
+
+void evaluate_model(MODEL *model, DOC **docs, double *target, long totdoc,
+		    GRID_POINT *point)
+     /* classifies the validation examples and stores error, recall,
+	and precision of the model in point */
+{
+  long i,correct=0,incorrect=0,res_a=0,res_b=0,res_c=0;
+  double *dist;
+
+  if(model->kernel_parm.kernel_type == RFF) 
+    add_weight_vector_to_linear_model(model);
+  compile_model(model);
+  dist=(double *)my_malloc(sizeof(double)*(totdoc+1));
+  classify_examples(model,docs,totdoc,dist);
+  for(i=0;i<totdoc;i++) {
+    if(dist[i]>0) {
+      if(target[i]>0) correct++; else incorrect++;
+      if(target[i]>0) res_a++; else res_b++;
+    }
+    else {
+      if(target[i]<0) correct++; else incorrect++;
+      if(target[i]>0) res_c++;
+    }
+  }
+  free(dist);
+
+  point->trained=1;
+  point->sv_num=model->sv_num-1;
+  point->error=100.0*incorrect/(double)maxl(correct+incorrect,1);
+  point->recall=100.0*res_a/(double)maxl(res_a+res_c,1);
+  point->precision=100.0*res_a/(double)maxl(res_a+res_b,1);
+}
+
+void measure_rate(GRID_POINT *point, DOC **docs, long totdoc)
+     /* measures how many of the examples docs the model of point
+	classifies per cpu-second, repeating the classification for at
+	least half a second */
+{
+  long reps=0,runtime_start,runtime;
+  double *dist;
+
+  dist=(double *)my_malloc(sizeof(double)*(totdoc+1));
+  runtime_start=get_runtime();
+  do {
+    classify_examples(point->model,docs,totdoc,dist);
+    reps++;
+    runtime=get_runtime()-runtime_start;
+  } while(runtime < 50);
+  point->rate=reps*totdoc/(runtime/100.0);
+  free(dist);
+}
+
+long parse_grid_list(char *list, double *vals, long zero)
+     /* reads the comma separated values in list into vals, sorted in
+	increasing order, and returns their number. The values must be
+	positive, or zero if zero is set. */
+{
+  long n=0;
+  char *end;
+
+  while(*list) {
+    if(n >= GRID_MAX) {
+      printf("\nAt most %d values per parameter!\n\n",GRID_MAX);
+      exit(1);
+    }
+    vals[n]=strtod(list,&end);
+    if((end == list) || ((*end != ',') && (*end != 0)) 
+       || (vals[n] < 0) || ((vals[n] == 0) && (!zero))) {
+      printf("\nInvalid list of %s values: %s\n\n",
+	     zero ? "non-negative" : "positive",list);
+      exit(1);
+    }
+    n++;
+    list=(*end)?end+1:end;
+  }
+  qsort(vals,n,sizeof(double),compare_double);
+  return(n);
+}
+
+int compare_double(const void *a, const void *b)
+{
+  if(*(double *)a < *(double *)b) return(-1);
+  if(*(double *)a > *(double *)b) return(1);
+  return(0);
+}
+
+void read_input_parameters(int argc,char *argv[],char *docfile,
+			   char *validfile,long *verbosity,
+			   LEARN_PARM *learn_parm,KERNEL_PARM *kernel_parm,
+			   double *cvals,long *cnum,double *gvals,long *gnum,
+			   double *jvals,long *jnum,double *dvals,long *dnum,
+			   long *patience,long *warmstart)
+{
+  long i;
+  char clist[1024],glist[1024],jlist[1024],dlist[1024];
+  
+  /* set default */
+  strcpy(clist,"1");
+  strcpy(glist,"1");
+  strcpy(jlist,"1");
+  strcpy(dlist,"0");
+  (*patience)=2;
+  (*warmstart)=0;
+  strcpy (learn_parm->predfile, "");
+  strcpy (learn_parm->alphafile, "");
+  (*verbosity)=1;
+  learn_parm->type=CLASSIFICATION;
+  learn_parm->biased_hyperplane=1;
+  learn_parm->sharedslack=0;
+  learn_parm->remove_inconsistent=0;
+  learn_parm->skip_final_opt_check=0;
+  learn_parm->svm_maxqpsize=10;
+  learn_parm->svm_newvarsinqp=0;
+  learn_parm->svm_smo=0;
+  learn_parm->svm_dcd=0;
+  learn_parm->svm_iter_to_shrink=-9999;
+  learn_parm->maxiter=100000;
+  learn_parm->kernel_cache_size=40;
+  learn_parm->shrink_history_size=40;
+  learn_parm->svm_c=0.0;
+  learn_parm->eps=0.1;
+  learn_parm->transduction_posratio=-1.0;
+  learn_parm->svm_costratio=1.0;
+  learn_parm->svm_costratio_unlab=1.0;
+  learn_parm->svm_unlabbound=1E-5;
+  learn_parm->epsilon_crit=0.001;
+  learn_parm->epsilon_a=1E-15;
+  learn_parm->compute_loo=0;
+  learn_parm->rho=1.0;
+  learn_parm->xa_depth=0;
+  kernel_parm->kernel_type=0;
+  kernel_parm->poly_degree=3;
+  kernel_parm->rbf_gamma=1.0;
+  kernel_parm->coef_lin=1;
+  kernel_parm->coef_const=1;
+  strcpy(kernel_parm->custom,"empty");
+  strcpy(kernel_parm->gram_file,"");
+  kernel_parm->gram=NULL;
+  kernel_parm->rff_dim=0;
+  kernel_parm->rff_seed=1;
+  kernel_parm->rff_proj=NULL;
+
+  for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
+    switch ((argv[i])[1]) 
+      { 
+      case '?': print_help(); exit(0);
+      case 'v': i++; (*verbosity)=atol(argv[i]); break;
+      case 'b': i++; learn_parm->biased_hyperplane=atol(argv[i]); break;
+      case 'q': i++; learn_parm->svm_maxqpsize=atol(argv[i]); break;
+      case 'n': i++; learn_parm->svm_newvarsinqp=atol(argv[i]); break;
+      case 'S': i++; learn_parm->svm_smo=atol(argv[i]); break;
+      case '#': i++; learn_parm->maxiter=atol(argv[i]); break;
+      case 'h': i++; learn_parm->svm_iter_to_shrink=atol(argv[i]); break;
+      case 'm': i++; learn_parm->kernel_cache_size=atol(argv[i]); break;
+      case 'H': i++; learn_parm->shrink_history_size=atol(argv[i]); break;
+      case 'c': i++; strcpy(clist,argv[i]); break;
+      case 'j': i++; strcpy(jlist,argv[i]); break;
+      case 'F': i++; strcpy(dlist,argv[i]); break;
+      case 'R': i++; kernel_parm->rff_seed=atol(argv[i]); break;
+      case 'e': i++; learn_parm->epsilon_crit=atof(argv[i]); break;
+      case 'P': i++; (*patience)=atol(argv[i]); break;
+      case 'w': i++; (*warmstart)=atol(argv[i]); break;
+      case 't': i++; kernel_parm->kernel_type=atol(argv[i]); break;
+      case 'd': i++; kernel_parm->poly_degree=atol(argv[i]); break;
+      case 'g': i++; strcpy(glist,argv[i]); break;
+      case 's': i++; kernel_parm->coef_lin=atof(argv[i]); break;
+      case 'r': i++; kernel_parm->coef_const=atof(argv[i]); break;
+      case 'u': i++; strcpy(kernel_parm->custom,argv[i]); break;
+      default: printf("\nUnrecognized option %s!\n\n",argv[i]);
+	       print_help();
+	       exit(0);
+      }
+  }
+  if((i+1)>=argc) {
+    printf("\nNot enough input parameters!\n\n");
+    print_help();
+    exit(0);
+  }
+  strcpy (docfile, argv[i]);
+  strcpy (validfile, argv[i+1]);
+  if(learn_parm->svm_iter_to_shrink == -9999) {
+    if(kernel_parm->kernel_type == LINEAR) 
+      learn_parm->svm_iter_to_shrink=2;
+    else
+      learn_parm->svm_iter_to_shrink=100;
+  }
+  if((kernel_parm->kernel_type < LINEAR) 
+     || (kernel_parm->kernel_type >= PRECOMPUTED)) {
+    printf("\nKernel type must be in [0..4]!\n\n");
+    print_help();
+    exit(0);
+  }
+  (*cnum)=parse_grid_list(clist,cvals,0);
+  (*gnum)=parse_grid_list(glist,gvals,0);
+  (*jnum)=parse_grid_list(jlist,jvals,0);
+  (*dnum)=parse_grid_list(dlist,dvals,1);
+  if(kernel_parm->kernel_type != RBF) {
+    (*gnum)=1;   /* gamma is only used by the rbf kernel */
+  }
+  for(i=0;i<(*dnum);i++) {
+    if((dvals[i] != (long)dvals[i]) || (((long)dvals[i]) % 2)) {
+      printf("\nThe numbers of random Fourier features must be even: %s\n\n",dlist);
+      print_help();
+      exit(0);
+    }
+    if((dvals[i] > 0) && (kernel_parm->kernel_type != RBF)) {
+      printf("\nRandom Fourier features approximate the rbf kernel (-t 2) only.\n\n");
+      print_help();
+      exit(0);
+    }
+  }
+  if(((*cnum) == 0) || ((*gnum) == 0) || ((*jnum) == 0) || ((*dnum) == 0)) {
+    printf("\nEmpty list of parameter values!\n\n");
+    print_help();
+    exit(0);
+  }
+}
+
+void print_help()
+{
+  printf("\nSVM-light %s: Support Vector Machine, grid search          %s\n",VERSION,VERSION_DATE);
+  copyright_notice();
+  printf("   usage: svm_grid [options] example_file validation_file\n\n");
+  printf("Arguments:\n");
+  printf("         example_file-> file with training data\n");
+  printf("         validation_file-> file with labeled examples to compute\n");
+  printf("                        the error of each grid point on\n");
+  printf("Options:\n");
+  printf("         -?          -> this help\n");
+  printf("         -v [0..3]   -> verbosity level (default 1)\n");
+  printf("Grid:    the values are given as comma separated lists\n");
+  printf("         -c list     -> values of C (default 1)\n");
+  printf("         -g list     -> values of gamma in rbf kernel (default 1)\n");
+  printf("         -j list     -> values of the cost-factor, by which training errors on\n");
+  printf("                        positive examples outweight errors on negative\n");
+  printf("                        examples (default 1)\n");
+  printf("         -F list     -> numbers of random Fourier features approximating the\n");
+  printf("                        rbf kernel, 0 for the exact kernel. If given, the\n");
+  printf("                        validation examples classified per cpu-second are\n");
+  printf("                        reported as well (default 0)\n");
+  printf("         -R int      -> seed of the random Fourier features (default 1)\n");
+  printf("         -P int      -> stop increasing C for a setting of gamma and j after\n");
+  printf("                        this many steps without improvement of the\n");
+  printf("                        validation error. 0 trains all (default 2)\n");
+  printf("         -w [0,1]    -> start each run from the alphas of the run with the\n");
+  printf("                        next smaller C (default 0)\n");
+  printf("Learning options:\n");
+  printf("         -b [0,1]    -> use biased hyperplane (i.e. x*w+b>0) instead\n");
+  printf("                        of unbiased hyperplane (i.e. x*w>0) (default 1)\n");
+  printf("Kernel options:\n");
+  printf("         -t int      -> type of kernel function:\n");
+  printf("                        0: linear (default)\n");
+  printf("                        1: polynomial (s a*b+c)^d\n");
+  printf("                        2: radial basis function exp(-gamma ||a-b||^2)\n");
+  printf("                        3: sigmoid tanh(s a*b + c)\n");
+  printf("                        4: user defined kernel from kernel.h\n");
+  printf("         -d int      -> parameter d in polynomial kernel\n");
+  printf("         -s float    -> parameter s in sigmoid/poly kernel\n");
+  printf("         -r float    -> parameter c in sigmoid/poly kernel\n");
+  printf("         -u string   -> parameter of user defined kernel\n");
+  printf("Optimization options:\n");
+  printf("         -q [2..]    -> maximum size of QP-subproblems (default 10)\n");
+  printf("         -n [2..q]   -> number of new variables entering the working set\n");
+  printf("                        in each iteration (default n = q)\n");
+  printf("         -S [0,1]    -> optimize working sets of two variables analytically\n");
+  printf("                        (SMO) instead of with the QP-solver. -q and -n\n");
+  printf("                        are ignored (default 0)\n");
+  printf("         -m [5..]    -> size of cache for kernel evaluations in MB for\n");
+  printf("                        each value of gamma (default 40)\n");
+  printf("         -H [0..]    -> memory for the history of alphas kept for shrinking\n");
+  printf("                        in MB for each training run (default 40)\n");
+  printf("         -e float    -> eps: Allow that error for termination criterion\n");
+  printf("                        [y [w*x+b] - 1] >= eps (default 0.001)\n");
+  printf("         -h [5..]    -> number of iterations a variable needs to be\n"); 
+  printf("                        optimal before considered for shrinking (default 100)\n");
+  printf("         -# int      -> terminate optimization, if no progress after this\n");
+  printf("                        number of iterations. (default 100000)\n\n");
+}
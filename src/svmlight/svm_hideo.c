@@ -50,23 +50,28 @@ long verbosity;
 # define EPSILON_HIDEO          1E-20
 # define EPSILON_EQ             1E-5
 
-double *optimize_qp(QP *, double *, long, double *, LEARN_PARM *);
-double *primal=0,*dual=0;
-long   precision_violations=0;
-double opt_precision=DEF_PRECISION;
-long   maxiter=DEF_MAX_ITERATIONS;
-double lindep_sensitivity=DEF_LINDEP_SENSITIVITY;
-double *buffer;
-long   *nonoptimal;
-
-long  smallroundcount=0;
-long  roundnumber=0;
+struct qp_solver {           /* state kept between calls of optimize_qp */
+  double *primal,*dual;      /* buffers, allocated at the first call */
+  double *buffer;
+  long   *nonoptimal;
+  long   precision_violations;
+  double opt_precision;
+  long   maxiter;
+  double lindep_sensitivity;
+  long   smallroundcount;
+  long   roundnumber;
+};
+
+QP_SOLVER *qp_solver_init(void);
+void   qp_solver_reset(QP_SOLVER *);
+void   qp_solver_cleanup(QP_SOLVER *);
+double *optimize_qp(QP_SOLVER *, QP *, double *, long, double *, LEARN_PARM *);
 
 /* /////////////////////////////////////////////////////////////// */
 
 void *my_malloc();
 
-int optimize_hildreth_despo(long,long,double,double,double,long,long,long,double,double *,
+int optimize_hildreth_despo(long,long,double,double,double,long,long,long,long,double,double *,
 			    double *,double *,double *,double *,double *,
 			    double *,double *,double *,long *,double *,double *);
 int solve_dual(long,long,double,double,long,double *,double *,double *,
@@ -84,7 +89,46 @@ double calculate_qp_objective(long, double *, double *, double *);
 
 
 
-double *optimize_qp(qp,epsilon_crit,nx,threshold,learn_parm)
+QP_SOLVER *qp_solver_init()
+/* returns a new solver state with the default parameters. Each
+   problem solved at the same time needs its own. */
+{
+  QP_SOLVER *s;
+
+  s=(QP_SOLVER *)my_malloc(sizeof(QP_SOLVER));
+  s->primal=0;
+  s->dual=0;
+  s->buffer=0;
+  s->nonoptimal=0;
+  qp_solver_reset(s);
+  return(s);
+}
+
+void qp_solver_reset(s)
+QP_SOLVER *s;
+/* restore the adaptive parameters of the solver to their defaults, so
+   that the next problem is solved independently of the ones before */
+{
+  s->precision_violations=0;
+  s->opt_precision=DEF_PRECISION;
+  s->maxiter=DEF_MAX_ITERATIONS;
+  s->lindep_sensitivity=DEF_LINDEP_SENSITIVITY;
+  s->smallroundcount=0;
+  s->roundnumber=0;
+}
+
+void qp_solver_cleanup(s)
+QP_SOLVER *s;
+{
+  free(s->primal);
+  free(s->dual);
+  free(s->buffer);
+  free(s->nonoptimal);
+  free(s);
+}
+
+double *optimize_qp(s,qp,epsilon_crit,nx,threshold,learn_parm)
+QP_SOLVER *s;
 QP *qp;
 double *epsilon_crit;
 long nx; /* Maximum number of variables in QP */
@@ -100,18 +144,18 @@ LEARN_PARM *learn_parm;
   int result;
   double eq,progress;
 
-  roundnumber++;
+  s->roundnumber++;
 
-  if(!primal) { /* allocate memory at first call */
-    primal=(double *)my_malloc(sizeof(double)*nx);
-    dual=(double *)my_malloc(sizeof(double)*((nx+1)*2));
-    nonoptimal=(long *)my_malloc(sizeof(long)*(nx));
-    buffer=(double *)my_malloc(sizeof(double)*((nx+1)*2*(nx+1)*2+
+  if(!s->primal) { /* allocate memory at first call */
+    s->primal=(double *)my_malloc(sizeof(double)*nx);
+    s->dual=(double *)my_malloc(sizeof(double)*((nx+1)*2));
+    s->nonoptimal=(long *)my_malloc(sizeof(long)*(nx));
+    s->buffer=(double *)my_malloc(sizeof(double)*((nx+1)*2*(nx+1)*2+
 					       nx*nx+2*(nx+1)*2+2*nx+1+2*nx+
 					       nx+nx+nx*nx));
     (*threshold)=0;
     for(i=0;i<nx;i++) {
-      primal[i]=0;
+      s->primal[i]=0;
     }
   }
 
@@ -137,14 +181,14 @@ LEARN_PARM *learn_parm;
   }
 
   result=optimize_hildreth_despo(qp->opt_n,qp->opt_m,
-				 opt_precision,(*epsilon_crit),
-				 learn_parm->epsilon_a,maxiter,
+				 s->opt_precision,(*epsilon_crit),
+				 learn_parm->epsilon_a,s->maxiter,
 				 /* (long)PRIMAL_OPTIMAL, */
-				 (long)0, (long)0,
-				 lindep_sensitivity,
+				 (long)0, (long)0, s->smallroundcount,
+				 s->lindep_sensitivity,
 				 qp->opt_g,qp->opt_g0,qp->opt_ce,qp->opt_ce0,
-				 qp->opt_low,qp->opt_up,primal,qp->opt_xinit,
-				 dual,nonoptimal,buffer,&progress);
+				 qp->opt_low,qp->opt_up,s->primal,qp->opt_xinit,
+				 s->dual,s->nonoptimal,s->buffer,&progress);
   if(verbosity>=3) { 
     printf("return(%d)...",result);
   }
@@ -155,50 +199,50 @@ LEARN_PARM *learn_parm;
   }
 
   if(result == NAN_SOLUTION) {
-    lindep_sensitivity*=2;  /* throw out linear dependent examples more */
+    s->lindep_sensitivity*=2;  /* throw out linear dependent examples more */
                             /* generously */
     if(learn_parm->svm_maxqpsize>2) {
       learn_parm->svm_maxqpsize--;  /* decrease size of qp-subproblems */
     }
-    precision_violations++;
+    s->precision_violations++;
   }
 
   /* take one round of only two variable to get unstuck */
-  if((result != PRIMAL_OPTIMAL) || (!(roundnumber % 31)) || (progress <= 0)) {
+  if((result != PRIMAL_OPTIMAL) || (!(s->roundnumber % 31)) || (progress <= 0)) {
 
-    smallroundcount++;
+    s->smallroundcount++;
 
     result=optimize_hildreth_despo(qp->opt_n,qp->opt_m,
-				   opt_precision,(*epsilon_crit),
-				   learn_parm->epsilon_a,(long)maxiter,
+				   s->opt_precision,(*epsilon_crit),
+				   learn_parm->epsilon_a,(long)s->maxiter,
 				   (long)PRIMAL_OPTIMAL,(long)SMALLROUND,
-				   lindep_sensitivity,
+				   s->smallroundcount,s->lindep_sensitivity,
 				   qp->opt_g,qp->opt_g0,qp->opt_ce,qp->opt_ce0,
-				   qp->opt_low,qp->opt_up,primal,qp->opt_xinit,
-				   dual,nonoptimal,buffer,&progress);
+				   qp->opt_low,qp->opt_up,s->primal,qp->opt_xinit,
+				   s->dual,s->nonoptimal,s->buffer,&progress);
     if(verbosity>=3) { 
       printf("return_srd(%d)...",result);
     }
 
     if(result != PRIMAL_OPTIMAL) {
       if(result != ONLY_ONE_VARIABLE) 
-	precision_violations++;
+	s->precision_violations++;
       if(result == MAXITER_EXCEEDED) 
-	maxiter+=100;
+	s->maxiter+=100;
       if(result == NAN_SOLUTION) {
-	lindep_sensitivity*=2;  /* throw out linear dependent examples more */
+	s->lindep_sensitivity*=2;  /* throw out linear dependent examples more */
 	                        /* generously */
 	/* results not valid, so return inital values */
 	for(i=0;i<qp->opt_n;i++) {
-	  primal[i]=qp->opt_xinit[i];
+	  s->primal[i]=qp->opt_xinit[i];
 	}
       }
     }
   }
 
 
-  if(precision_violations > 50) {
-    precision_violations=0;
+  if(s->precision_violations > 50) {
+    s->precision_violations=0;
     (*epsilon_crit)*=10.0; 
     if(verbosity>=1) {
       printf("\nWARNING: Relaxing epsilon on KT-Conditions (%f).\n",
@@ -206,8 +250,8 @@ LEARN_PARM *learn_parm;
     }
   }	  
 
-  if((qp->opt_m>0) && (result != NAN_SOLUTION) && (!isnan(dual[1]-dual[0])))
-    (*threshold)=dual[1]-dual[0];
+  if((qp->opt_m>0) && (result != NAN_SOLUTION) && (!isnan(s->dual[1]-s->dual[0])))
+    (*threshold)=s->dual[1]-s->dual[0];
   else
     (*threshold)=0;
 
@@ -215,27 +259,28 @@ LEARN_PARM *learn_parm;
     printf("\n\n");
     eq=qp->opt_ce0[0];
     for(i=0;i<qp->opt_n;i++) {
-      eq+=primal[i]*qp->opt_ce[i];
+      eq+=s->primal[i]*qp->opt_ce[i];
       printf("%f: ",qp->opt_g0[i]);
       for(j=0;j<qp->opt_n;j++) {
 	printf("%f ",qp->opt_g[i*qp->opt_n+j]);
       }
-      printf(": a=%.30f",primal[i]);
-      printf(": nonopti=%ld",nonoptimal[i]);
+      printf(": a=%.30f",s->primal[i]);
+      printf(": nonopti=%ld",s->nonoptimal[i]);
       printf(": y=%f\n",qp->opt_ce[i]);
     }
     printf("eq-constraint=%.30f\n",eq);
     printf("b=%f\n",(*threshold));
-    printf(" smallroundcount=%ld ",smallroundcount);
+    printf(" smallroundcount=%ld ",s->smallroundcount);
   }
 
-  return(primal);
+  return(s->primal);
 }
 
 
 
 int optimize_hildreth_despo(n,m,precision,epsilon_crit,epsilon_a,maxiter,goal,
-			    smallround,lindep_sensitivity,g,g0,ce,ce0,low,up,
+			    smallround,smallroundcount,lindep_sensitivity,
+			    g,g0,ce,ce0,low,up,
 			    primal,init,dual,lin_dependent,buffer,progress)
      long   n;            /* number of variables */
      long   m;            /* number of linear equality constraints [0,1] */
@@ -245,6 +290,7 @@ int optimize_hildreth_despo(n,m,precision,epsilon_crit,epsilon_a,maxiter,goal,
      long   maxiter;      /* stop after this many iterations */
      long   goal;         /* keep going until goal fulfilled */
      long   smallround;   /* use only two variables of steepest descent */
+     long   smallroundcount; /* number of small rounds so far */
      double lindep_sensitivity; /* epsilon for detecting linear dependent ex */
      double *g;           /* hessian of objective */
      double *g0;          /* linear part of objective */
@@ -22,7 +22,10 @@
 
 
 /* interface to QP-solver */
-double *optimize_qp(QP *, double *, long, double *, LEARN_PARM *);
+QP_SOLVER *qp_solver_init(void);
+void   qp_solver_reset(QP_SOLVER *);
+void   qp_solver_cleanup(QP_SOLVER *);
+double *optimize_qp(QP_SOLVER *, QP *, double *, long, double *, LEARN_PARM *);
 
 /*---------------------------------------------------------------------------*/
 
@@ -64,23 +67,24 @@ void svm_learn_classification(DOC **docs, double *class, long int
   long loocomputed=0,runtime_start_loo=0,runtime_start_xa=0;
   double heldout_c=0,r_delta_sq=0,r_delta,r_delta_avg;
   long *index,*index2dnum;
-  double *weights;
+  SPARSE_ACCU *weights;
   CFLOAT *aicache;  /* buffer to keep one row of hessian */
 
   double *xi_fullset; /* buffer for storing xi on full sample in loo */
   double *a_fullset;  /* buffer for storing alpha on full sample in loo */
   TIMING timing_profile;
   SHRINK_STATE shrink_state;
+  SOLVER_CONTEXT solver;
 
   runtime_start=get_runtime();
   timing_profile.time_kernel=0;
   timing_profile.time_opti=0;
   timing_profile.time_shrink=0;
+  timing_profile.time_reactivate=0;
   timing_profile.time_update=0;
   timing_profile.time_model=0;
   timing_profile.time_check=0;
   timing_profile.time_select=0;
-  kernel_cache_statistic=0;
 
   learn_parm->totwords=totwords;
 
@@ -91,6 +95,7 @@ void svm_learn_classification(DOC **docs, double *class, long int
   }
 
   init_shrink_state(&shrink_state,totdoc,(long)MAXSHRINK);
+  init_solver_context(&solver);
 
   label = (long *)my_malloc(sizeof(long)*totdoc);
   inconsistent = (long *)my_malloc(sizeof(long)*totdoc);
@@ -110,6 +115,7 @@ void svm_learn_classification(DOC **docs, double *class, long int
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->compiled=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -180,7 +186,7 @@ void svm_learn_classification(DOC **docs, double *class, long int
     }
     index = (long *)my_malloc(sizeof(long)*totdoc);
     index2dnum = (long *)my_malloc(sizeof(long)*(totdoc+11));
-    weights=(double *)my_malloc(sizeof(double)*(totwords+1));
+    weights=sparse_accu_init(totwords);
     aicache = (CFLOAT *)my_malloc(sizeof(CFLOAT)*totdoc);
     for(i=0;i<totdoc;i++) {    /* create full index and clip alphas */
       index[i]=1;
@@ -188,20 +194,22 @@ void svm_learn_classification(DOC **docs, double *class, long int
       if(alpha[i]<0) alpha[i]=0;
       if(alpha[i]>learn_parm->svm_cost[i]) alpha[i]=learn_parm->svm_cost[i];
     }
-    if(kernel_parm->kernel_type != LINEAR) {
+    if((kernel_parm->kernel_type != LINEAR) && kernel_cache) {
       for(i=0;i<totdoc;i++)     /* fill kernel cache with unbounded SV */
 	if((alpha[i]>0) && (alpha[i]<learn_parm->svm_cost[i]) 
 	   && (kernel_cache_space_available(kernel_cache))) 
-	  cache_kernel_row(kernel_cache,docs,i,kernel_parm);
+	  cache_kernel_row(kernel_cache,docs,i,kernel_parm,
+			   &solver.kernel_evals);
       for(i=0;i<totdoc;i++)     /* fill rest of kernel cache with bounded SV */
 	if((alpha[i]==learn_parm->svm_cost[i]) 
 	   && (kernel_cache_space_available(kernel_cache))) 
-	  cache_kernel_row(kernel_cache,docs,i,kernel_parm);
+	  cache_kernel_row(kernel_cache,docs,i,kernel_parm,
+			   &solver.kernel_evals);
     }
     (void)compute_index(index,totdoc,index2dnum);
     update_linear_component(docs,label,index2dnum,alpha,a,index2dnum,totdoc,
 			    totwords,kernel_parm,kernel_cache,lin,aicache,
-			    weights);
+			    weights,&solver.kernel_evals);
     (void)calculate_svm_model(docs,label,unlabeled,lin,alpha,a,c,
 			      learn_parm,index2dnum,index2dnum,model);
     for(i=0;i<totdoc;i++) {    /* copy initial alphas */
@@ -209,7 +217,7 @@ void svm_learn_classification(DOC **docs, double *class, long int
     }
     free(index);
     free(index2dnum);
-    free(weights);
+    sparse_accu_free(weights);
     free(aicache);
     if(verbosity>=1) {
       printf("done.\n");  fflush(stdout);
@@ -243,13 +251,27 @@ void svm_learn_classification(DOC **docs, double *class, long int
     printf("Optimizing"); fflush(stdout);
   }
 
+  if(learn_parm->svm_dcd 
+     && ((kernel_parm->kernel_type != LINEAR) || transduction 
+	 || learn_parm->remove_inconsistent)) {
+    learn_parm->svm_dcd=0;
+    if(verbosity >= 1)
+      printf("\nDual coordinate descent requires a linear kernel, no transduction,\nand -i 0. Using the decomposition method instead.\n\n");
+  }
+
   /* train the svm */
-  iterations=optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
-				     kernel_parm,kernel_cache,&shrink_state,model,
-				     inconsistent,unlabeled,a,lin,
-				     c,&timing_profile,
-				     &maxdiff,(long)-1,
-				     (long)1);
+  if(learn_parm->svm_dcd) {
+    iterations=optimize_linear_dcd(docs,label,totdoc,totwords,learn_parm,
+				   model,a,lin,&maxdiff);
+  }
+  else {
+    iterations=optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
+				       kernel_parm,kernel_cache,&shrink_state,
+				       &solver,model,inconsistent,unlabeled,a,
+				       lin,c,&timing_profile,
+				       &maxdiff,(long)-1,
+				       (long)1);
+  }
   
   if(verbosity>=1) {
     if(verbosity==1) printf("done. (%ld iterations)\n",iterations);
@@ -265,11 +287,12 @@ void svm_learn_classification(DOC **docs, double *class, long int
 
     runtime_end=get_runtime();
     if(verbosity>=2) {
-      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for final/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
+      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for shrink/%.2f%% for reactivate/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
         ((float)runtime_end-(float)runtime_start)/100.0,
         (100.0*timing_profile.time_kernel)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_opti)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_shrink)/(float)(runtime_end-runtime_start),
+	(100.0*timing_profile.time_reactivate)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_update)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_model)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_check)/(float)(runtime_end-runtime_start),
@@ -343,7 +366,8 @@ void svm_learn_classification(DOC **docs, double *class, long int
       }
     }
     if(verbosity>=1) {
-      printf("Number of kernel evaluations: %ld\n",kernel_cache_statistic);
+      printf("Number of kernel evaluations: %ld\n",solver.kernel_evals);
+      kernel_cache_print_statistic(kernel_cache);
     }
   }
 
@@ -360,73 +384,190 @@ void svm_learn_classification(DOC **docs, double *class, long int
     if(verbosity>=1) {
       printf("Computing leave-one-out");
     }
-    
-    /* repeat this loop for every held-out example */
-    for(heldout=0;(heldout<totdoc);heldout++) {
-      if(learn_parm->rho*a_fullset[heldout]*r_delta_sq+xi_fullset[heldout]
-	 < 1.0) { 
-	/* guaranteed to not produce a leave-one-out error */
-	if(verbosity==1) {
-	  printf("+"); fflush(stdout); 
-	}
-      }
-      else if(xi_fullset[heldout] > 1.0) {
-	/* guaranteed to produce a leave-one-out error */
-	loo_count++;
-	if(label[heldout] > 0)  loo_count_pos++; else loo_count_neg++;
-	if(verbosity==1) {
-	  printf("-"); fflush(stdout); 
-	}
-      }
-      else {
-	loocomputed++;
-	heldout_c=learn_parm->svm_cost[heldout]; /* set upper bound to zero */
-	learn_parm->svm_cost[heldout]=0;
-	/* make sure heldout example is not currently  */
-	/* shrunk away. Assumes that lin is up to date! */
-	shrink_state.active[heldout]=1;  
-	if(verbosity>=2) 
-	  printf("\nLeave-One-Out test on example %ld\n",heldout);
-	if(verbosity>=1) {
-	  printf("(?[%ld]",heldout); fflush(stdout); 
-	}
-	
-	optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
-				kernel_parm,
-				kernel_cache,&shrink_state,model,inconsistent,unlabeled,
-				a,lin,c,&timing_profile,
-				&maxdiff,heldout,(long)2);
-
-	/* printf("%.20f\n",(lin[heldout]-model->b)*(double)label[heldout]); */
 
-	if(((lin[heldout]-model->b)*(double)label[heldout]) <= 0.0) { 
-	  loo_count++;                            /* there was a loo-error */
+    if(learn_parm->compute_loo != 2) {
+      /* repeat this loop for every held-out example */
+      for(heldout=0;(heldout<totdoc);heldout++) {
+	if(learn_parm->rho*a_fullset[heldout]*r_delta_sq+xi_fullset[heldout]
+	   < 1.0) { 
+	  /* guaranteed to not produce a leave-one-out error */
+	  if(verbosity==1) {
+	    printf("+"); fflush(stdout); 
+	  }
+	}
+	else if(xi_fullset[heldout] > 1.0) {
+	  /* guaranteed to produce a leave-one-out error */
+	  loo_count++;
 	  if(label[heldout] > 0)  loo_count_pos++; else loo_count_neg++;
-	  if(verbosity>=1) {
-	    printf("-)"); fflush(stdout); 
+	  if(verbosity==1) {
+	    printf("-"); fflush(stdout); 
 	  }
 	}
 	else {
+	  loocomputed++;
+	  heldout_c=learn_parm->svm_cost[heldout]; /* set upper bound to zero */
+	  learn_parm->svm_cost[heldout]=0;
+	  /* make sure heldout example is not currently  */
+	  /* shrunk away. Assumes that lin is up to date! */
+	  shrink_state.active[heldout]=1;  
+	  if(verbosity>=2) 
+	    printf("\nLeave-One-Out test on example %ld\n",heldout);
 	  if(verbosity>=1) {
-	    printf("+)"); fflush(stdout); 
+	    printf("(?[%ld]",heldout); fflush(stdout); 
+	  }
+	
+	  optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
+				  kernel_parm,kernel_cache,&shrink_state,
+				  &solver,model,inconsistent,unlabeled,
+				  a,lin,c,&timing_profile,
+				  &maxdiff,heldout,(long)2);
+
+	  /* printf("%.20f\n",(lin[heldout]-model->b)*(double)label[heldout]); */
+
+	  if(((lin[heldout]-model->b)*(double)label[heldout]) <= 0.0) { 
+	    loo_count++;                            /* there was a loo-error */
+	    if(label[heldout] > 0)  loo_count_pos++; else loo_count_neg++;
+	    if(verbosity>=1) {
+	      printf("-)"); fflush(stdout); 
+	    }
+	  }
+	  else {
+	    if(verbosity>=1) {
+	      printf("+)"); fflush(stdout); 
+	    }
 	  }
+	  /* now we need to restore the original data set*/
+	  learn_parm->svm_cost[heldout]=heldout_c; /* restore upper bound */
 	}
-	/* now we need to restore the original data set*/
-	learn_parm->svm_cost[heldout]=heldout_c; /* restore upper bound */
-      }
-    } /* end of leave-one-out loop */
+      } /* end of leave-one-out loop */
 
 
-    if(verbosity>=1) {
-      printf("\nRetrain on full problem"); fflush(stdout); 
+      if(verbosity>=1) {
+	printf("\nRetrain on full problem"); fflush(stdout); 
+      }
+      optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
+			      kernel_parm,kernel_cache,&shrink_state,
+			      &solver,model,inconsistent,unlabeled,
+			      a,lin,c,&timing_profile,
+			      &maxdiff,(long)-1,(long)1);
+      if(verbosity >= 1) 
+	printf("done.\n");
+    }
+    else {
+      /* Every held-out run starts again from the solution on the
+	 full set, so the runs do not depend on each other and are
+	 spread over the threads. Each thread works on its own copy of
+	 the solver state and only looks up rows in the kernel cache of
+	 the full run, which stays unchanged. */
+#pragma omp parallel
+      {
+	LEARN_PARM loo_parm;
+	MODEL loo_model;
+	SHRINK_STATE loo_shrink;
+	SOLVER_CONTEXT loo_solver;
+	KERNEL_CACHE loo_cache,*loo_cachep=NULL;
+	TIMING loo_timing;
+	double loo_maxdiff,*loo_a,*loo_lin,*loo_cost;
+	long j;
+
+	loo_a = (double *)my_malloc(sizeof(double)*totdoc);
+	loo_lin = (double *)my_malloc(sizeof(double)*totdoc);
+	loo_cost = (double *)my_malloc(sizeof(double)*totdoc);
+	for(j=0;j<totdoc;j++) {
+	  loo_cost[j]=learn_parm->svm_cost[j];
+	}
+	loo_model=(*model);
+	loo_model.supvec = (DOC **)my_malloc(sizeof(DOC *)*(totdoc+2));
+	loo_model.alpha = (double *)my_malloc(sizeof(double)*(totdoc+2));
+	loo_model.index = (long *)my_malloc(sizeof(long)*(totdoc+2));
+	init_shrink_state(&loo_shrink,totdoc,(long)MAXSHRINK);
+	init_solver_context(&loo_solver);
+	if(kernel_cache) {
+	  loo_cache=(*kernel_cache);
+	  loo_cache.readonly=1;
+	  loo_cachep=&loo_cache;
+	}
+	loo_timing=timing_profile;
+
+	/* repeat this loop for every held-out example */
+#pragma omp for schedule(dynamic) reduction(+:loo_count,loo_count_pos,loo_count_neg,loocomputed)
+	for(heldout=0;heldout<totdoc;heldout++) {
+	  if(learn_parm->rho*a_fullset[heldout]*r_delta_sq+xi_fullset[heldout]
+	     < 1.0) { 
+	    /* guaranteed to not produce a leave-one-out error */
+	    if(verbosity==1) {
+	      printf("+"); fflush(stdout); 
+	    }
+	  }
+	  else if(xi_fullset[heldout] > 1.0) {
+	    /* guaranteed to produce a leave-one-out error */
+	    loo_count++;
+	    if(label[heldout] > 0)  loo_count_pos++; else loo_count_neg++;
+	    if(verbosity==1) {
+	      printf("-"); fflush(stdout); 
+	    }
+	  }
+	  else {
+	    loocomputed++;
+	    /* restart from the full solution with the upper bound of the
+	       heldout example set to zero */
+	    loo_parm=(*learn_parm);
+	    loo_parm.svm_cost=loo_cost;
+	    loo_cost[heldout]=0;
+	    for(j=0;j<totdoc;j++) {
+	      loo_a[j]=a_fullset[j];
+	      loo_lin[j]=lin[j];
+	      loo_model.index[j]=model->index[j];
+	    }
+	    for(j=0;j<model->sv_num;j++) {
+	      loo_model.supvec[j]=model->supvec[j];
+	      loo_model.alpha[j]=model->alpha[j];
+	    }
+	    loo_model.sv_num=model->sv_num;
+	    loo_model.at_upper_bound=model->at_upper_bound;
+	    loo_model.b=model->b;
+	    shrink_state_reset(&loo_shrink,totdoc);
+	    qp_solver_reset(loo_solver.qp_solver);
+	    if(verbosity>=2) 
+	      printf("\nLeave-One-Out test on example %ld\n",heldout);
+	    if(verbosity>=1) {
+	      printf("(?[%ld]",heldout); fflush(stdout); 
+	    }
+	
+	    optimize_to_convergence(docs,label,totdoc,totwords,&loo_parm,
+				    kernel_parm,loo_cachep,&loo_shrink,&loo_solver,
+				    &loo_model,inconsistent,unlabeled,
+				    loo_a,loo_lin,c,&loo_timing,
+				    &loo_maxdiff,heldout,(long)2);
+
+	    if(((loo_lin[heldout]-loo_model.b)*(double)label[heldout]) <= 0.0) { 
+	      loo_count++;                            /* there was a loo-error */
+	      if(label[heldout] > 0)  loo_count_pos++; else loo_count_neg++;
+	      if(verbosity>=1) {
+		printf("-)"); fflush(stdout); 
+	      }
+	    }
+	    else {
+	      if(verbosity>=1) {
+		printf("+)"); fflush(stdout); 
+	      }
+	    }
+	    loo_cost[heldout]=learn_parm->svm_cost[heldout]; /* restore bound */
+	  }
+	} /* end of leave-one-out loop */
+
+	shrink_state_cleanup(&loo_shrink);
+	solver_context_cleanup(&loo_solver);
+	free(loo_model.supvec);
+	free(loo_model.alpha);
+	free(loo_model.index);
+	free(loo_a);
+	free(loo_lin);
+	free(loo_cost);
+      }
+      if(verbosity >= 1) 
+	printf("\n");
     }
-    optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
-			    kernel_parm,
-			    kernel_cache,&shrink_state,model,inconsistent,unlabeled,
-			    a,lin,c,&timing_profile,
-			    &maxdiff,(long)-1,(long)1);
-    if(verbosity >= 1) 
-      printf("done.\n");
     
     
     /* after all leave-one-out computed */
@@ -448,10 +589,17 @@ void svm_learn_classification(DOC **docs, double *class, long int
     }
   }
     
+  if(alpha) {
+    for(i=0;i<totdoc;i++) {    /* copy final alphas */
+      alpha[i]=a[i];
+    }
+  }
+ 
   if(learn_parm->alphafile[0])
     write_alphas(learn_parm->alphafile,a,label,totdoc);
   
   shrink_state_cleanup(&shrink_state);
+  solver_context_cleanup(&solver);
   free(label);
   free(inconsistent);
   free(unlabeled);
@@ -495,6 +643,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   double *a_fullset;  /* buffer for storing alpha on full sample in loo */
   TIMING timing_profile;
   SHRINK_STATE shrink_state;
+  SOLVER_CONTEXT solver;
   DOC **docs_org;
   long *label;
 
@@ -516,7 +665,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
 
   /* need to get a bigger kernel cache */
   if(*kernel_cache) {
-    kernel_cache_size=(*kernel_cache)->buffsize*sizeof(CFLOAT)/(1024*1024);
+    kernel_cache_size=(*kernel_cache)->buffsize*sizeof(KFLOAT)/(1024*1024);
     kernel_cache_cleanup(*kernel_cache);
     (*kernel_cache)=kernel_cache_init(totdoc,kernel_cache_size);
   }
@@ -525,11 +674,11 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   timing_profile.time_kernel=0;
   timing_profile.time_opti=0;
   timing_profile.time_shrink=0;
+  timing_profile.time_reactivate=0;
   timing_profile.time_update=0;
   timing_profile.time_model=0;
   timing_profile.time_check=0;
   timing_profile.time_select=0;
-  kernel_cache_statistic=0;
 
   learn_parm->totwords=totwords;
 
@@ -540,6 +689,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   }
 
   init_shrink_state(&shrink_state,totdoc,(long)MAXSHRINK);
+  init_solver_context(&solver);
 
   inconsistent = (long *)my_malloc(sizeof(long)*totdoc);
   unlabeled = (long *)my_malloc(sizeof(long)*totdoc);
@@ -557,6 +707,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->compiled=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -606,7 +757,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   /* train the svm */
   iterations=optimize_to_convergence(docs,label,totdoc,totwords,learn_parm,
 				     kernel_parm,*kernel_cache,&shrink_state,
-				     model,inconsistent,unlabeled,a,lin,c,
+				     &solver,model,inconsistent,unlabeled,a,lin,c,
 				     &timing_profile,&maxdiff,(long)-1,
 				     (long)1);
   
@@ -617,11 +768,12 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
 
     runtime_end=get_runtime();
     if(verbosity>=2) {
-      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for final/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
+      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for shrink/%.2f%% for reactivate/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
         ((float)runtime_end-(float)runtime_start)/100.0,
         (100.0*timing_profile.time_kernel)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_opti)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_shrink)/(float)(runtime_end-runtime_start),
+	(100.0*timing_profile.time_reactivate)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_update)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_model)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_check)/(float)(runtime_end-runtime_start),
@@ -668,7 +820,8 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
 	      length_of_longest_document_vector(docs,totdoc,kernel_parm));
     }
     if(verbosity>=1) {
-      printf("Number of kernel evaluations: %ld\n",kernel_cache_statistic);
+      printf("Number of kernel evaluations: %ld\n",solver.kernel_evals);
+      kernel_cache_print_statistic(*kernel_cache);
     }
   }
     
@@ -686,6 +839,7 @@ void svm_learn_regression(DOC **docs, double *value, long int totdoc,
   }
   
   shrink_state_cleanup(&shrink_state);
+  solver_context_cleanup(&solver);
   for(i=0;i<totdoc;i++)
     free_example(docs[i],0);
   free(docs);
@@ -785,7 +939,7 @@ void svm_learn_ranking(DOC **docs, double *rankvalue, long int totdoc,
 
   /* need to get a bigger kernel cache */
   if(*kernel_cache) {
-    kernel_cache_size=(*kernel_cache)->buffsize*sizeof(CFLOAT)/(1024*1024);
+    kernel_cache_size=(*kernel_cache)->buffsize*sizeof(KFLOAT)/(1024*1024);
     kernel_cache_cleanup(*kernel_cache);
     (*kernel_cache)=kernel_cache_init(totpair,kernel_cache_size);
   }
@@ -826,6 +980,7 @@ void svm_learn_ranking(DOC **docs, double *rankvalue, long int totdoc,
   model->at_upper_bound=0;
   model->b=0;	       
   model->lin_weights=NULL;
+  model->compiled=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -886,21 +1041,23 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
   long *unlabeled,*inconsistent;
   double r_delta_sq=0,r_delta,r_delta_avg;
   long *index,*index2dnum;
-  double *weights,*slack,*alphaslack;
+  SPARSE_ACCU *weights;
+  double *slack,*alphaslack;
   CFLOAT *aicache;  /* buffer to keep one row of hessian */
 
   TIMING timing_profile;
   SHRINK_STATE shrink_state;
+  SOLVER_CONTEXT solver;
 
   runtime_start=get_runtime();
   timing_profile.time_kernel=0;
   timing_profile.time_opti=0;
   timing_profile.time_shrink=0;
+  timing_profile.time_reactivate=0;
   timing_profile.time_update=0;
   timing_profile.time_model=0;
   timing_profile.time_check=0;
   timing_profile.time_select=0;
-  kernel_cache_statistic=0;
 
   learn_parm->totwords=totwords;
 
@@ -911,6 +1068,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
   }
 
   init_shrink_state(&shrink_state,totdoc,(long)MAXSHRINK);
+  init_solver_context(&solver);
 
   label = (long *)my_malloc(sizeof(long)*totdoc);
   unlabeled = (long *)my_malloc(sizeof(long)*totdoc);
@@ -928,6 +1086,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
   model->supvec[0]=0;  /* element 0 reserved and empty for now */
   model->alpha[0]=0;
   model->lin_weights=NULL;
+  model->compiled=NULL;
   model->totwords=totwords;
   model->totdoc=totdoc;
   model->kernel_parm=(*kernel_parm);
@@ -981,7 +1140,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
     }
     index = (long *)my_malloc(sizeof(long)*totdoc);
     index2dnum = (long *)my_malloc(sizeof(long)*(totdoc+11));
-    weights=(double *)my_malloc(sizeof(double)*(totwords+1));
+    weights=sparse_accu_init(totwords);
     aicache = (CFLOAT *)my_malloc(sizeof(CFLOAT)*totdoc);
     for(i=0;i<totdoc;i++) {    /* create full index and clip alphas */
       index[i]=1;
@@ -989,20 +1148,22 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
       if(alpha[i]<0) alpha[i]=0;
       if(alpha[i]>learn_parm->svm_cost[i]) alpha[i]=learn_parm->svm_cost[i];
     }
-    if(kernel_parm->kernel_type != LINEAR) {
+    if((kernel_parm->kernel_type != LINEAR) && kernel_cache) {
       for(i=0;i<totdoc;i++)     /* fill kernel cache with unbounded SV */
 	if((alpha[i]>0) && (alpha[i]<learn_parm->svm_cost[i]) 
 	   && (kernel_cache_space_available(kernel_cache))) 
-	  cache_kernel_row(kernel_cache,docs,i,kernel_parm);
+	  cache_kernel_row(kernel_cache,docs,i,kernel_parm,
+			   &solver.kernel_evals);
       for(i=0;i<totdoc;i++)     /* fill rest of kernel cache with bounded SV */
 	if((alpha[i]==learn_parm->svm_cost[i]) 
 	   && (kernel_cache_space_available(kernel_cache))) 
-	  cache_kernel_row(kernel_cache,docs,i,kernel_parm);
+	  cache_kernel_row(kernel_cache,docs,i,kernel_parm,
+			   &solver.kernel_evals);
     }
     (void)compute_index(index,totdoc,index2dnum);
     update_linear_component(docs,label,index2dnum,alpha,a,index2dnum,totdoc,
 			    totwords,kernel_parm,kernel_cache,lin,aicache,
-			    weights);
+			    weights,&solver.kernel_evals);
     (void)calculate_svm_model(docs,label,unlabeled,lin,alpha,a,c,
 			      learn_parm,index2dnum,index2dnum,model);
     for(i=0;i<totdoc;i++) {    /* copy initial alphas */
@@ -1010,7 +1171,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
     }
     free(index);
     free(index2dnum);
-    free(weights);
+    sparse_accu_free(weights);
     free(aicache);
     if(verbosity>=1) {
       printf("done.\n");  fflush(stdout);
@@ -1036,13 +1197,13 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
   if(learn_parm->sharedslack)
     iterations=optimize_to_convergence_sharedslack(docs,label,totdoc,
 				     totwords,learn_parm,kernel_parm,
-				     kernel_cache,&shrink_state,model,
+				     kernel_cache,&shrink_state,&solver,model,
 				     a,lin,c,&timing_profile,
 				     &maxdiff);
   else
     iterations=optimize_to_convergence(docs,label,totdoc,
 				     totwords,learn_parm,kernel_parm,
-				     kernel_cache,&shrink_state,model,
+				     kernel_cache,&shrink_state,&solver,model,
 				     inconsistent,unlabeled,
 				     a,lin,c,&timing_profile,
 				     &maxdiff,(long)-1,(long)1);
@@ -1060,11 +1221,12 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
 
     runtime_end=get_runtime();
     if(verbosity>=2) {
-      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for final/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
+      printf("Runtime in cpu-seconds: %.2f (%.2f%% for kernel/%.2f%% for optimizer/%.2f%% for shrink/%.2f%% for reactivate/%.2f%% for update/%.2f%% for model/%.2f%% for check/%.2f%% for select)\n",
         ((float)runtime_end-(float)runtime_start)/100.0,
         (100.0*timing_profile.time_kernel)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_opti)/(float)(runtime_end-runtime_start),
 	(100.0*timing_profile.time_shrink)/(float)(runtime_end-runtime_start),
+	(100.0*timing_profile.time_reactivate)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_update)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_model)/(float)(runtime_end-runtime_start),
         (100.0*timing_profile.time_check)/(float)(runtime_end-runtime_start),
@@ -1146,7 +1308,8 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
 	    length_of_longest_document_vector(docs,totdoc,kernel_parm));
   }
   if(verbosity>=1) {
-    printf("Number of kernel evaluations: %ld\n",kernel_cache_statistic);
+    printf("Number of kernel evaluations: %ld\n",solver.kernel_evals);
+    kernel_cache_print_statistic(kernel_cache);
   }
     
   if(alpha) {
@@ -1159,6 +1322,7 @@ void svm_learn_optimization(DOC **docs, double *rhs, long int
     write_alphas(learn_parm->alphafile,a,label,totdoc);
   
   shrink_state_cleanup(&shrink_state);
+  solver_context_cleanup(&solver);
   free(label);
   free(unlabeled);
   free(inconsistent);
@@ -1173,7 +1337,8 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 			     long int totwords, LEARN_PARM *learn_parm, 
 			     KERNEL_PARM *kernel_parm, 
 			     KERNEL_CACHE *kernel_cache, 
-			     SHRINK_STATE *shrink_state, MODEL *model, 
+			     SHRINK_STATE *shrink_state, 
+			     SOLVER_CONTEXT *solver, MODEL *model, 
 			     long int *inconsistent, long int *unlabeled, 
 			     double *a, double *lin, double *c, 
 			     TIMING *timing_profile, double *maxdiff, 
@@ -1188,6 +1353,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
      /* kernel_cache: Initialized/partly filled Cache, if using a kernel. 
                       NULL if linear. */
      /* shrink_state: State of active variables */
+     /* solver: State of the QP-solver and of transduction */
      /* model: Returns learning result */
      /* inconsistent: examples thrown out as inconstistent */
      /* unlabeled: test examples for transduction */
@@ -1202,7 +1368,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   long inconsistentnum,choosenum,already_chosen=0,iteration;
   long misclassified,supvecnum=0,*active2dnum,inactivenum;
   long *working2dnum,*selexam;
-  long activenum;
+  long activenum,evals;
   double criterion,eq;
   double *a_old;
   long t0=0,t1=0,t2=0,t3=0,t4=0,t5=0,t6=0; /* timing */
@@ -1214,7 +1380,9 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 
   double *selcrit;  /* buffer for sorting */        
   CFLOAT *aicache;  /* buffer to keep one row of hessian */
-  double *weights;  /* buffer for weight vector in linear case */
+  SPARSE_ACCU *weights; /* buffer for weight vector in linear case */
+  double *kdiag;    /* diagonal of the kernel matrix */
+  double *kdiagbuf; /* diagonal for SMO, if there is no kernel cache */
   QP qp;            /* buffer for one quadratic program */
 
   epsilon_crit_org=learn_parm->epsilon_crit; /* save org */
@@ -1229,8 +1397,8 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 
   chosen = (long *)my_malloc(sizeof(long)*totdoc);
   last_suboptimal_at = (long *)my_malloc(sizeof(long)*totdoc);
-  key = (long *)my_malloc(sizeof(long)*(totdoc+11)); 
-  selcrit = (double *)my_malloc(sizeof(double)*totdoc);
+  key = (long *)my_malloc(sizeof(long)*(2*totdoc+11)); 
+  selcrit = (double *)my_malloc(sizeof(double)*2*totdoc);
   selexam = (long *)my_malloc(sizeof(long)*totdoc);
   a_old = (double *)my_malloc(sizeof(double)*totdoc);
   aicache = (CFLOAT *)my_malloc(sizeof(CFLOAT)*totdoc);
@@ -1244,7 +1412,20 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   qp.opt_xinit = (double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
   qp.opt_low=(double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
   qp.opt_up=(double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
-  weights=(double *)my_malloc(sizeof(double)*(totwords+1));
+  weights=sparse_accu_init(totwords);
+  kdiag=NULL;
+  kdiagbuf=NULL;
+  if(kernel_cache) 
+    kdiag=kernel_cache_diagonal(kernel_cache,docs,totdoc,kernel_parm,
+				&solver->kernel_evals);
+  if((!kdiag) && learn_parm->svm_smo) {
+    kdiagbuf=(double *)my_malloc(sizeof(double)*totdoc);
+    evals=0;
+    for(i=0;i<totdoc;i++) 
+      kdiagbuf[i]=kernel_nostat(kernel_parm,docs[i],docs[i],&evals);
+    count_kernel_evals(&solver->kernel_evals,evals);
+    kdiag=kdiagbuf;
+  }
 
   choosenum=0;
   inconsistentnum=0;
@@ -1256,11 +1437,6 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   bestmaxdiff=999999999;
   terminate=0;
 
-  if(kernel_cache) {
-    kernel_cache->time=iteration;  /* for lru cache */
-    kernel_cache_reset_lru(kernel_cache);
-  }
-
   for(i=0;i<totdoc;i++) {    /* various inits */
     chosen[i]=0;
     a_old[i]=a[i];
@@ -1278,8 +1454,6 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
                             /* repeat this loop until we have convergence */
   for(;retrain && (!terminate);iteration++) {
 
-    if(kernel_cache)
-      kernel_cache->time=iteration;  /* for lru cache */
     if(verbosity>=2) {
       printf(
 	"Iteration %ld: ",iteration); fflush(stdout);
@@ -1348,6 +1522,15 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
       }
       compute_index(chosen,totdoc,working2dnum);
     }
+    else if(learn_parm->svm_smo) { /* select pair by second order gain */
+      for(jj=0;(j=working2dnum[jj])>=0;jj++) {
+	chosen[j]=0; 
+      }
+      choosenum=select_next_qp_pair(docs,label,a,lin,c,totdoc,learn_parm,
+				    inconsistent,active2dnum,working2dnum,
+				    kernel_cache,kernel_parm,kdiag,aicache,
+				    chosen,&solver->kernel_evals);
+    }
     else {      /* select working set according to steepest gradient */
       if(iteration % 101) {
         already_chosen=0;
@@ -1394,19 +1577,24 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 
     if(kernel_cache) 
       cache_multiple_kernel_rows(kernel_cache,docs,working2dnum,
-				 choosenum,kernel_parm); 
+				 choosenum,kernel_parm,&solver->kernel_evals); 
     
     if(verbosity>=2) t2=get_runtime();
-    if(retrain != 2) {
+    if((retrain != 2) && learn_parm->svm_smo) {
+      optimize_pair(label,a,lin,c,learn_parm,working2dnum,kdiag,aicache);
+    }
+    else if(retrain != 2) {
       optimize_svm(docs,label,unlabeled,inconsistent,0.0,chosen,active2dnum,
 		   model,totdoc,working2dnum,choosenum,a,lin,c,learn_parm,
-		   aicache,kernel_parm,&qp,&epsilon_crit_org);
+		   aicache,kernel_parm,kernel_cache,kdiag,&qp,
+		   solver->qp_solver,&epsilon_crit_org,
+		   &solver->kernel_evals);
     }
 
     if(verbosity>=2) t3=get_runtime();
     update_linear_component(docs,label,active2dnum,a,a_old,working2dnum,totdoc,
 			    totwords,kernel_parm,kernel_cache,lin,aicache,
-			    weights);
+			    weights,&solver->kernel_evals);
 
     if(verbosity>=2) t4=get_runtime();
     supvecnum=calculate_svm_model(docs,label,unlabeled,lin,a,a_old,c,
@@ -1480,7 +1668,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
       reactivate_inactive_examples(label,unlabeled,a,shrink_state,lin,c,totdoc,
 				   totwords,iteration,learn_parm,inconsistent,
 				   docs,kernel_parm,kernel_cache,model,aicache,
-				   weights,maxdiff);
+				   weights,maxdiff,&solver->kernel_evals);
       /* Update to new active variables. */
       activenum=compute_index(shrink_state->active,totdoc,active2dnum);
       inactivenum=totdoc-activenum;
@@ -1492,7 +1680,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
       retrain=0;
       if((*maxdiff) > learn_parm->epsilon_crit) 
 	retrain=1;
-      timing_profile->time_shrink+=get_runtime()-t1;
+      timing_profile->time_reactivate+=get_runtime()-t1;
       if(((verbosity>=1) && (kernel_parm->kernel_type != LINEAR)) 
 	 || (verbosity>=2)) {
 	printf("done.\n");  fflush(stdout);
@@ -1530,7 +1718,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 					     unlabeled,a,lin,totdoc,
 					     selcrit,selexam,key,
 					     transductcycle,kernel_parm,
-					     learn_parm);
+					     learn_parm,solver);
       epsilon_crit_org=learn_parm->epsilon_crit;
       if(kernel_parm->kernel_type == LINEAR)
 	learn_parm->epsilon_crit=1; 
@@ -1540,6 +1728,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
       bestmaxdiffiter=iteration;
     } 
     else if(((iteration % 10) == 0) && (!noshrink)) {
+      t1=get_runtime();
       activenum=shrink_problem(docs,learn_parm,shrink_state,kernel_parm,
 			       active2dnum,last_suboptimal_at,iteration,totdoc,
 			       maxl((long)(activenum/10),
@@ -1554,6 +1743,7 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
 				 (kernel_cache->activenum-supvecnum)),
 			    shrink_state->active); 
       }
+      timing_profile->time_shrink+=get_runtime()-t1;
     }
 
     if((!retrain) && learn_parm->remove_inconsistent) {
@@ -1603,7 +1793,9 @@ long optimize_to_convergence(DOC **docs, long int *label, long int totdoc,
   free(qp.opt_xinit);
   free(qp.opt_low);
   free(qp.opt_up);
-  free(weights);
+  sparse_accu_free(weights);
+  if(kdiagbuf)
+    free(kdiagbuf);
 
   learn_parm->epsilon_crit=epsilon_crit_org; /* restore org */
   model->maxdiff=(*maxdiff);
@@ -1616,7 +1808,8 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
 			     long int totwords, LEARN_PARM *learn_parm, 
 			     KERNEL_PARM *kernel_parm, 
 			     KERNEL_CACHE *kernel_cache, 
-			     SHRINK_STATE *shrink_state, MODEL *model, 
+			     SHRINK_STATE *shrink_state, 
+			     SOLVER_CONTEXT *solver, MODEL *model, 
 			     double *a, double *lin, double *c, 
 			     TIMING *timing_profile, double *maxdiff)
      /* docs: Training vectors (x-part) */
@@ -1629,6 +1822,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
      /* kernel_cache: Initialized/partly filled Cache, if using a kernel. 
                       NULL if linear. */
      /* shrink_state: State of active variables */
+     /* solver: State of the QP-solver and of transduction */
      /* model: Returns learning result */
      /* a: alphas */
      /* lin: linear component of gradient */
@@ -1649,7 +1843,8 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
 
   double *selcrit;  /* buffer for sorting */        
   CFLOAT *aicache;  /* buffer to keep one row of hessian */
-  double *weights;  /* buffer for weight vector in linear case */
+  SPARSE_ACCU *weights; /* buffer for weight vector in linear case */
+  double *kdiag;    /* diagonal of the kernel matrix */
   QP qp;            /* buffer for one quadratic program */
   double *slack;    /* vector of slack variables for optimization with
 		       shared slacks */
@@ -1668,8 +1863,8 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   unlabeled = (long *)my_malloc(sizeof(long)*totdoc);
   inconsistent = (long *)my_malloc(sizeof(long)*totdoc);
   ignore = (long *)my_malloc(sizeof(long)*totdoc);
-  key = (long *)my_malloc(sizeof(long)*(totdoc+11)); 
-  selcrit = (double *)my_malloc(sizeof(double)*totdoc);
+  key = (long *)my_malloc(sizeof(long)*(2*totdoc+11)); 
+  selcrit = (double *)my_malloc(sizeof(double)*2*totdoc);
   selexam = (long *)my_malloc(sizeof(long)*totdoc);
   a_old = (double *)my_malloc(sizeof(double)*totdoc);
   aicache = (CFLOAT *)my_malloc(sizeof(CFLOAT)*totdoc);
@@ -1683,7 +1878,11 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   qp.opt_xinit = (double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
   qp.opt_low=(double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
   qp.opt_up=(double *)my_malloc(sizeof(double)*learn_parm->svm_maxqpsize);
-  weights=(double *)my_malloc(sizeof(double)*(totwords+1));
+  weights=sparse_accu_init(totwords);
+  kdiag=NULL;
+  if(kernel_cache) 
+    kdiag=kernel_cache_diagonal(kernel_cache,docs,totdoc,kernel_parm,
+				&solver->kernel_evals);
   maxslackid=0;
   for(i=0;i<totdoc;i++) {    /* determine size of slack array */
     if(maxslackid<docs[i]->slackid)
@@ -1705,11 +1904,6 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   bestmaxdiff=999999999;
   terminate=0;
 
-  if(kernel_cache) {
-    kernel_cache->time=iteration;  /* for lru cache */
-    kernel_cache_reset_lru(kernel_cache);
-  }
-
   for(i=0;i<totdoc;i++) {    /* various inits */
     chosen[i]=0;
     unlabeled[i]=0;
@@ -1728,8 +1922,6 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
                             /* repeat this loop until we have convergence */
   for(;retrain && (!terminate);iteration++) {
 
-    if(kernel_cache)
-      kernel_cache->time=iteration;  /* for lru cache */
     if(verbosity>=2) {
       printf(
 	"Iteration %ld: ",iteration); fflush(stdout);
@@ -1846,13 +2038,14 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
 
     if(kernel_cache) 
       cache_multiple_kernel_rows(kernel_cache,docs,working2dnum,
-				 choosenum,kernel_parm); 
+				 choosenum,kernel_parm,&solver->kernel_evals); 
 
     if(verbosity>=2) t2=get_runtime();
     if(jointstep) learn_parm->biased_hyperplane=1;
     optimize_svm(docs,label,unlabeled,ignore,eq_target,chosen,active2dnum,
 		 model,totdoc,working2dnum,choosenum,a,lin,c,learn_parm,
-		 aicache,kernel_parm,&qp,&epsilon_crit_org);
+		 aicache,kernel_parm,kernel_cache,kdiag,&qp,solver->qp_solver,
+		 &epsilon_crit_org,&solver->kernel_evals);
     learn_parm->biased_hyperplane=0;
 
     for(jj=0;(i=working2dnum[jj])>=0;jj++)   /* recompute sums of alphas */
@@ -1877,7 +2070,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
     if(verbosity>=2) t3=get_runtime();
     update_linear_component(docs,label,active2dnum,a,a_old,working2dnum,totdoc,
 			    totwords,kernel_parm,kernel_cache,lin,aicache,
-			    weights);
+			    weights,&solver->kernel_evals);
     compute_shared_slacks(docs,label,a,lin,c,active2dnum,learn_parm,
 			  slack,alphaslack);
 
@@ -1946,7 +2139,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
       reactivate_inactive_examples(label,unlabeled,a,shrink_state,lin,c,totdoc,
 				   totwords,iteration,learn_parm,inconsistent,
 				   docs,kernel_parm,kernel_cache,model,aicache,
-				   weights,maxdiff);
+				   weights,maxdiff,&solver->kernel_evals);
       /* Update to new active variables. */
       activenum=compute_index(shrink_state->active,totdoc,active2dnum);
       inactivenum=totdoc-activenum;
@@ -1966,7 +2159,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
       retrain=0;
       if((*maxdiff) > learn_parm->epsilon_crit) 
 	retrain=1;
-      timing_profile->time_shrink+=get_runtime()-t1;
+      timing_profile->time_reactivate+=get_runtime()-t1;
       if(((verbosity>=1) && (kernel_parm->kernel_type != LINEAR)) 
 	 || (verbosity>=2)) {
 	printf("done.\n");  fflush(stdout);
@@ -1994,6 +2187,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
     }
 
     if(((iteration % 10) == 0) && (!noshrink)) {
+      t1=get_runtime();
       activenum=shrink_problem(docs,learn_parm,shrink_state,
 			       kernel_parm,active2dnum,
 			       last_suboptimal_at,iteration,totdoc,
@@ -2009,6 +2203,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
 				 (kernel_cache->activenum-supvecnum)),
 			    shrink_state->active); 
       }
+      timing_profile->time_shrink+=get_runtime()-t1;
     }
 
   } /* end of loop */
@@ -2035,7 +2230,7 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   free(qp.opt_xinit);
   free(qp.opt_low);
   free(qp.opt_up);
-  free(weights);
+  sparse_accu_free(weights);
 
   learn_parm->epsilon_crit=epsilon_crit_org; /* restore org */
   model->maxdiff=(*maxdiff);
@@ -2043,6 +2238,169 @@ long optimize_to_convergence_sharedslack(DOC **docs, long int *label,
   return(iteration);
 }
 
+long optimize_linear_dcd(DOC **docs, long int *label, long int totdoc, 
+			 long int totwords, LEARN_PARM *learn_parm, 
+			 MODEL *model, double *a, double *lin, 
+			 double *maxdiff)
+     /* Trains a linear SVM by dual coordinate descent (Hsieh, Chang,
+	Lin, Keerthi, Sundararajan, 2008). The weight vector is kept
+	explicitly, so each step costs one sparse dot product and one
+	sparse update. The variables are visited in random order and
+	variables at a bound are shrunk when their gradient points out
+	of the box. The threshold is learned as the weight of a constant
+	feature of value 1, so unlike the decomposition method it is
+	regularized and there is no equality constraint. On return a,
+	lin, maxdiff and the model (including lin_weights) are set as
+	by optimize_to_convergence. Returns the number of passes over
+	the active examples. */
+{
+  long i,s,t,iteration,activenum,terminate;
+  long *index;
+  double *w,*qd,wb,bias,g,pg,pgmax,pgmin,pgmax_old,pgmin_old,a_old,d;
+  unsigned long rnd=1;
+  SVECTOR *f,*f2;
+
+  bias=learn_parm->biased_hyperplane ? 1.0 : 0.0;
+  w=(double *)my_malloc(sizeof(double)*(totwords+1));
+  qd=(double *)my_malloc(sizeof(double)*totdoc);
+  index=(long *)my_malloc(sizeof(long)*totdoc);
+
+  clear_vector_n(w,totwords);
+  wb=0;
+  for(i=0;i<totdoc;i++) {    /* start from the given alphas */
+    index[i]=i;
+    qd[i]=bias;
+    for(f=docs[i]->fvec;f;f=f->next) 
+      for(f2=docs[i]->fvec;f2;f2=f2->next) 
+	qd[i]+=f->factor*f2->factor*sprod_ss(f,f2);
+    if(a[i] != 0) {
+      for(f=docs[i]->fvec;f;f=f->next) 
+	add_vector_ns(w,f,f->factor*a[i]*(double)label[i]);
+      wb+=bias*a[i]*(double)label[i];
+    }
+  }
+
+  activenum=totdoc;
+  pgmax_old=1E300;
+  pgmin_old=-1E300;
+  pgmax=pgmin=0;
+  terminate=0;
+  for(iteration=1;!terminate;iteration++) {
+    if(verbosity==1) {
+      printf("."); fflush(stdout);
+    }
+    for(s=0;s<activenum;s++) { /* random permutation of active examples */
+      rnd=rnd*1103515245+12345;
+      t=s+(long)((rnd>>16)%(unsigned long)(activenum-s));
+      i=index[s]; index[s]=index[t]; index[t]=i;
+    }
+    pgmax=-1E300;
+    pgmin=1E300;
+    for(s=0;s<activenum;s++) {
+      i=index[s];
+      g=wb*bias;
+      for(f=docs[i]->fvec;f;f=f->next) 
+	g+=f->factor*sprod_ns(w,f);
+      g=g*(double)label[i]-1.0;
+      pg=0;
+      if(a[i] <= 0) {
+	if(g > pgmax_old) {   /* will stay at zero */
+	  activenum--;
+	  index[s]=index[activenum]; index[activenum]=i;
+	  s--;
+	  continue;
+	}
+	if(g < 0) pg=g;
+      }
+      else if(a[i] >= learn_parm->svm_cost[i]) {
+	if(g < pgmin_old) {   /* will stay at upper bound */
+	  activenum--;
+	  index[s]=index[activenum]; index[activenum]=i;
+	  s--;
+	  continue;
+	}
+	if(g > 0) pg=g;
+      }
+      else 
+	pg=g;
+      if(pg > pgmax) pgmax=pg;
+      if(pg < pgmin) pgmin=pg;
+
+      if(fabs(pg) > 1E-12) {
+	a_old=a[i];
+	if(qd[i] > 0) 
+	  a[i]=a[i]-g/qd[i];
+	else 
+	  a[i]=learn_parm->svm_cost[i];
+	if(a[i] < 0) a[i]=0;
+	if(a[i] > learn_parm->svm_cost[i]) a[i]=learn_parm->svm_cost[i];
+	d=(a[i]-a_old)*(double)label[i];
+	for(f=docs[i]->fvec;f;f=f->next) 
+	  add_vector_ns(w,f,f->factor*d);
+	wb+=bias*d;
+      }
+    }
+    if(activenum == 0) {
+      pgmax=pgmin=0;
+    }
+    if(verbosity>=2) {
+      printf("Iteration %ld: %ld active, max violation=%.5f\n",iteration,
+	     activenum,pgmax-pgmin); fflush(stdout);
+    }
+
+    if(pgmax-pgmin <= learn_parm->epsilon_crit) {
+      if(activenum == totdoc) {
+	terminate=1;
+      }
+      else {         /* check the shrunk variables in a full pass */
+	activenum=totdoc;
+	pgmax_old=1E300;
+	pgmin_old=-1E300;
+      }
+    }
+    else {
+      pgmax_old=(pgmax > 0) ? pgmax : 1E300;
+      pgmin_old=(pgmin < 0) ? pgmin : -1E300;
+    }
+    if((!terminate) && (iteration >= learn_parm->maxiter)) {
+      terminate=1;
+      if(verbosity>=1) 
+	printf("\nWARNING: Relaxing KT-Conditions due to slow progress! Terminating!\n");
+    }
+  }
+  (*maxdiff)=pgmax-pgmin;
+
+#pragma omp parallel for private(f) schedule(static)
+  for(i=0;i<totdoc;i++) {
+    lin[i]=0;
+    for(f=docs[i]->fvec;f;f=f->next) 
+      lin[i]+=f->factor*sprod_ns(w,f);
+  }
+
+  model->b=-wb*bias;
+  model->sv_num=1;
+  model->at_upper_bound=0;
+  for(i=0;i<totdoc;i++) {
+    model->index[i]=-1;
+    if(a[i] > 0) {
+      model->supvec[model->sv_num]=docs[i];
+      model->alpha[model->sv_num]=a[i]*(double)label[i];
+      model->index[i]=model->sv_num;
+      model->sv_num++;
+      if(a[i] >= learn_parm->svm_cost[i]-learn_parm->epsilon_a)
+	model->at_upper_bound++;
+    }
+  }
+  if(model->lin_weights)
+    free(model->lin_weights);
+  model->lin_weights=w;
+  model->maxdiff=(*maxdiff);
+
+  free(qd);
+  free(index);
+  return(iteration-1);
+}
+
 
 double compute_objective_function(double *a, double *lin, double *c, 
 				  double eps, long int *label, 
@@ -2100,8 +2458,10 @@ void optimize_svm(DOC **docs, long int *label, long int *unlabeled,
 		  long int *chosen, long int *active2dnum, MODEL *model, 
 		  long int totdoc, long int *working2dnum, long int varnum, 
 		  double *a, double *lin, double *c, LEARN_PARM *learn_parm, 
-		  CFLOAT *aicache, KERNEL_PARM *kernel_parm, QP *qp, 
-		  double *epsilon_crit_target)
+		  CFLOAT *aicache, KERNEL_PARM *kernel_parm, 
+		  KERNEL_CACHE *kernel_cache, double *kdiag, QP *qp, 
+		  QP_SOLVER *qp_solver, double *epsilon_crit_target,
+		  long *kernel_evals)
      /* Do optimization on the working set. */
 {
     long i;
@@ -2111,13 +2471,14 @@ void optimize_svm(DOC **docs, long int *label, long int *unlabeled,
 				      exclude_from_eq_const,eq_target,chosen,
 				      active2dnum,working2dnum,model,a,lin,c,
 				      varnum,totdoc,learn_parm,aicache,
-				      kernel_parm,qp);
+				      kernel_parm,kernel_cache,kdiag,qp,
+				      kernel_evals);
 
     if(verbosity>=3) {
       printf("Running optimizer..."); fflush(stdout);
     }
     /* call the qp-subsolver */
-    a_v=optimize_qp(qp,epsilon_crit_target,
+    a_v=optimize_qp(qp_solver,qp,epsilon_crit_target,
 		    learn_parm->svm_maxqpsize,
 		    &(model->b),   /* in case the optimizer gives us */
                                    /* the threshold for free. otherwise */
@@ -2140,15 +2501,96 @@ void optimize_svm(DOC **docs, long int *label, long int *unlabeled,
     }
 }
 
+void optimize_pair(long int *label, double *a, double *lin, double *c, 
+		   LEARN_PARM *learn_parm, long int *working2dnum, 
+		   double *kdiag, CFLOAT *aicache)
+     /* Solve the subproblem on the working set selected by
+	select_next_qp_pair analytically. aicache holds the row of the
+	first variable. */
+{
+  long i,j;
+  double gi,gj,ci,cj,ai,aj,quad,delta,diff,sum;
+
+  if((i=working2dnum[0]) < 0)
+    return;
+  j=working2dnum[1];
+  gi=learn_parm->eps-(double)label[i]*c[i]+(double)label[i]*lin[i];
+  ci=learn_parm->svm_cost[i];
+
+  if(j < 0) {         /* single variable without equality constraint */
+    quad=kdiag[i];
+    if(quad<=0) 
+      quad=SMO_TAU;
+    ai=a[i]-gi/quad;
+    if(ai<0) ai=0;
+    if(ai>ci) ai=ci;
+    a[i]=ai;
+    return;
+  }
+
+  gj=learn_parm->eps-(double)label[j]*c[j]+(double)label[j]*lin[j];
+  cj=learn_parm->svm_cost[j];
+  ai=a[i];
+  aj=a[j];
+  quad=kdiag[i]+kdiag[j]-2.0*aicache[j];
+  if(quad<=0)
+    quad=SMO_TAU;
+
+  if(label[i] != label[j]) { /* move along a_i-a_j=const */
+    delta=(-gi-gj)/quad;
+    diff=ai-aj;
+    ai+=delta;
+    aj+=delta;
+    if(diff > 0) {
+      if(aj < 0) { aj=0; ai=diff; }
+    }
+    else {
+      if(ai < 0) { ai=0; aj=-diff; }
+    }
+    if(diff > ci-cj) {
+      if(ai > ci) { ai=ci; aj=ci-diff; }
+    }
+    else {
+      if(aj > cj) { aj=cj; ai=cj+diff; }
+    }
+  }
+  else {                     /* move along a_i+a_j=const */
+    delta=(gi-gj)/quad;
+    sum=ai+aj;
+    ai-=delta;
+    aj+=delta;
+    if(sum > ci) {
+      if(ai > ci) { ai=ci; aj=sum-ci; }
+    }
+    else {
+      if(aj < 0) { aj=0; ai=sum; }
+    }
+    if(sum > cj) {
+      if(aj > cj) { aj=cj; ai=sum-cj; }
+    }
+    else {
+      if(ai < 0) { ai=0; aj=sum; }
+    }
+  }
+  a[i]=ai;
+  a[j]=aj;
+}
+
 void compute_matrices_for_optimization(DOC **docs, long int *label, 
           long int *unlabeled, long *exclude_from_eq_const, double eq_target,
 	  long int *chosen, long int *active2dnum, 
           long int *key, MODEL *model, double *a, double *lin, double *c, 
 	  long int varnum, long int totdoc, LEARN_PARM *learn_parm, 
-          CFLOAT *aicache, KERNEL_PARM *kernel_parm, QP *qp)
+          CFLOAT *aicache, KERNEL_PARM *kernel_parm, 
+	  KERNEL_CACHE *kernel_cache, double *kdiag, QP *qp, 
+	  long *kernel_evals)
+     /* The kernel values are taken from the rows of the working set in
+	kernel_cache and from the diagonal kdiag where available. Both
+	may be NULL. */
 {
   register long ki,kj,i,j;
   register double kernel_temp;
+  long evals=0;
 
   if(verbosity>=3) {
     fprintf(stdout,"Computing qp-matrices (type %ld kernel [degree %ld, rbf_gamma %f, coef_lin %f, coef_const %f])...",kernel_parm->kernel_type,kernel_parm->poly_degree,kernel_parm->rbf_gamma,kernel_parm->coef_lin,kernel_parm->coef_const); 
@@ -2181,14 +2623,18 @@ void compute_matrices_for_optimization(DOC **docs, long int *label,
     qp->opt_low[i]=0;
     qp->opt_up[i]=learn_parm->svm_cost[ki];
 
-    kernel_temp=(double)kernel(kernel_parm,docs[ki],docs[ki]); 
+    if(kdiag)
+      kernel_temp=kdiag[ki];
+    else
+      kernel_temp=kernel_nostat(kernel_parm,docs[ki],docs[ki],&evals); 
     /* compute linear part of objective function */
     qp->opt_g0[i]-=(kernel_temp*a[ki]*(double)label[ki]); 
     /* compute quadratic part of objective function */
     qp->opt_g[varnum*i+i]=kernel_temp;
     for(j=i+1;j<varnum;j++) {
       kj=key[j];
-      kernel_temp=(double)kernel(kernel_parm,docs[ki],docs[kj]);
+      kernel_temp=get_kernel_elem(kernel_cache,docs,ki,kj,kernel_parm,
+				  &evals);
       /* compute linear part of objective function */
       qp->opt_g0[i]-=(kernel_temp*a[kj]*(double)label[kj]);
       qp->opt_g0[j]-=(kernel_temp*a[ki]*(double)label[ki]); 
@@ -2203,6 +2649,7 @@ void compute_matrices_for_optimization(DOC **docs, long int *label,
       }
     }
   }
+  count_kernel_evals(kernel_evals,evals);
 
   for(i=0;i<varnum;i++) {
     /* assure starting at feasible point */
@@ -2588,7 +3035,8 @@ void update_linear_component(DOC **docs, long int *label,
 			     long int totdoc, long int totwords, 
 			     KERNEL_PARM *kernel_parm, 
 			     KERNEL_CACHE *kernel_cache, 
-			     double *lin, CFLOAT *aicache, double *weights)
+			     double *lin, CFLOAT *aicache, SPARSE_ACCU *weights,
+			     long *kernel_evals)
      /* keep track of the linear component */
      /* lin of the gradient etc. by updating */
      /* based on the change of the variables */
@@ -2599,24 +3047,25 @@ void update_linear_component(DOC **docs, long int *label,
   SVECTOR *f;
 
   if(kernel_parm->kernel_type==0) { /* special linear case */
-    clear_vector_n(weights,totwords);
+    sparse_accu_clear(weights);
     for(ii=0;(i=working2dnum[ii])>=0;ii++) {
       if(a[i] != a_old[i]) {
 	for(f=docs[i]->fvec;f;f=f->next)  
-	  add_vector_ns(weights,f,
-			f->factor*((a[i]-a_old[i])*(double)label[i]));
+	  sparse_accu_add(weights,f,
+			  f->factor*((a[i]-a_old[i])*(double)label[i]));
       }
     }
+    sparse_accu_compact(weights);
     for(jj=0;(j=active2dnum[jj])>=0;jj++) {
       for(f=docs[j]->fvec;f;f=f->next)  
-	lin[j]+=f->factor*sprod_ns(weights,f);
+	lin[j]+=f->factor*sparse_accu_sprod(weights,f);
     }
   }
   else {                            /* general case */
     for(jj=0;(i=working2dnum[jj])>=0;jj++) {
       if(a[i] != a_old[i]) {
 	get_kernel_row(kernel_cache,docs,i,totdoc,active2dnum,aicache,
-		       kernel_parm);
+		       kernel_parm,kernel_evals);
 	for(ii=0;(j=active2dnum[ii])>=0;ii++) {
 	  tec=aicache[j];
 	  lin[j]+=(((a[i]*tec)-(a_old[i]*tec))*(double)label[i]);
@@ -2635,19 +3084,18 @@ long incorporate_unlabeled_examples(MODEL *model, long int *label,
 				    long int *select, long int *key, 
 				    long int transductcycle, 
 				    KERNEL_PARM *kernel_parm, 
-				    LEARN_PARM *learn_parm)
+				    LEARN_PARM *learn_parm,
+				    SOLVER_CONTEXT *solver)
 {
   long i,j,k,j1,j2,j3,j4,unsupaddnum1=0,unsupaddnum2=0;
   long pos,neg,upos,uneg,orgpos,orgneg,nolabel,newpos,newneg,allunlab;
   double dist,model_length,posratio,negratio;
   long check_every=2;
   double loss;
-  static double switchsens=0.0,switchsensorg=0.0;
   double umin,umax,sumalpha;
   long imin=0,imax=0;
-  static long switchnum=0;
 
-  switchsens/=1.2;
+  solver->switchsens/=1.2;
 
   /* assumes that lin[] is up to date -> no inactive vars */
 
@@ -2878,7 +3326,7 @@ long incorporate_unlabeled_examples(MODEL *model, long int *label,
 	  imax=i;
 	}
       }
-      if((umin < (umax+switchsens-1E-4))) {
+      if((umin < (umax+solver->switchsens-1E-4))) {
 	j1++;
 	j2++;
 	unsupaddnum1++;	
@@ -2904,11 +3352,11 @@ long incorporate_unlabeled_examples(MODEL *model, long int *label,
 	j3++;
       }
     }
-    switchnum+=unsupaddnum1+unsupaddnum2;
+    solver->switchnum+=unsupaddnum1+unsupaddnum2;
 
     /* stop and print out current margin
-       printf("switchnum %ld %ld\n",switchnum,kernel_parm->poly_degree);
-       if(switchnum == 2*kernel_parm->poly_degree) {
+       printf("switchnum %ld %ld\n",solver->switchnum,kernel_parm->poly_degree);
+       if(solver->switchnum == 2*kernel_parm->poly_degree) {
        learn_parm->svm_unlabbound=1;
        }
        */
@@ -2922,10 +3370,10 @@ long incorporate_unlabeled_examples(MODEL *model, long int *label,
 	write_prediction(learn_parm->predfile,model,lin,a,unlabeled,label,
 			 totdoc,learn_parm);  
 	if(verbosity>=1)
-	  printf("Number of switches: %ld\n",switchnum);
+	  printf("Number of switches: %ld\n",solver->switchnum);
 	return((long)0);
       }
-      switchsens=switchsensorg;
+      solver->switchsens=solver->switchsensorg;
       learn_parm->svm_unlabbound*=1.5;
       if(learn_parm->svm_unlabbound>1) {
 	learn_parm->svm_unlabbound=1;
@@ -2983,36 +3431,44 @@ long select_next_qp_subproblem_grad(long int *label,
      /* Use the feasible direction approach to select the next
       qp-subproblem (see chapter 'Selecting a good working set'). If
       'cache_only' is true, then the variables are selected only among
-      those for which the kernel evaluations are cached. */
+      those for which the kernel evaluations are cached. selcrit and
+      key must have room for 2*totdoc elements. */
 {
-  long choosenum,i,j,k,activedoc,inum,valid;
-  double s;
+  long choosenum,i,j,k,inum,down,up,upsel,*keyup;
+  long *cacheindex,valid,notfixed;
+  double g,*selcritup;
 
   for(inum=0;working2dnum[inum]>=0;inum++); /* find end of index */
   choosenum=0;
-  activedoc=0;
+
+  /* Both directions are collected in one pass, examples that can
+     move down (-y) in the first half of selcrit and key, examples
+     that can move up (y) in the second. The tests are evaluated
+     without branches and each candidate is written before the
+     position is advanced, so the loop does not stall on mispredicted
+     tests. */
+  cacheindex=(kernel_cache && cache_only) ? kernel_cache->index : NULL;
+  selcritup=selcrit+totdoc;
+  keyup=key+totdoc;
+  down=0;
+  up=0;
   for(i=0;(j=active2dnum[i])>=0;i++) {
-    s=-label[j];
-    if(kernel_cache && cache_only) 
-      valid=(kernel_cache->index[j]>=0);
-    else
-      valid=1;
-    if(valid
-       && (!((a[j]<=(0+learn_parm->epsilon_a)) && (s<0)))
-       && (!((a[j]>=(learn_parm->svm_cost[j]-learn_parm->epsilon_a)) 
-	     && (s>0)))
-       && (!chosen[j]) 
-       && (label[j])
-       && (!inconsistent[j]))
-      {
-      selcrit[activedoc]=(double)label[j]*(learn_parm->eps-(double)label[j]*c[j]+(double)label[j]*lin[j]);
-      /*      selcrit[activedoc]=(double)label[j]*(-1.0+(double)label[j]*lin[j]); */
-      key[activedoc]=j;
-      activedoc++;
-    }
-  }
-  select_top_n(selcrit,activedoc,select,(long)(qp_size/2));
-  for(k=0;(choosenum<(qp_size/2)) && (k<(qp_size/2)) && (k<activedoc);k++) {
+    g=(double)label[j]*(learn_parm->eps-(double)label[j]*c[j]+(double)label[j]*lin[j]);
+    /*      g=(double)label[j]*(-1.0+(double)label[j]*lin[j]); */
+    valid=((!cacheindex) || (cacheindex[j]>=0))
+      & (!chosen[j]) & (label[j]!=0) & (!inconsistent[j]);
+    notfixed=(a[j]>(0+learn_parm->epsilon_a)) 
+      | ((a[j]<(learn_parm->svm_cost[j]-learn_parm->epsilon_a)) << 1);
+    selcrit[down]=g;
+    key[down]=j;
+    down+=valid & (notfixed >> ((label[j]>0) ? 0 : 1));
+    selcritup[up]=-g;
+    keyup[up]=j;
+    up+=valid & (notfixed >> ((label[j]>0) ? 1 : 0));
+  }
+
+  select_top_n(selcrit,down,select,(long)(qp_size/2));
+  for(k=0;(choosenum<(qp_size/2)) && (k<(qp_size/2)) && (k<down);k++) {
     /* if(learn_parm->biased_hyperplane || (selcrit[select[k]] > 0)) { */
       i=key[select[k]];
       chosen[i]=1;
@@ -3024,34 +3480,19 @@ long select_next_qp_subproblem_grad(long int *label,
       /* } */
   }
 
-  activedoc=0;
-  for(i=0;(j=active2dnum[i])>=0;i++) {
-    s=label[j];
-    if(kernel_cache && cache_only) 
-      valid=(kernel_cache->index[j]>=0);
-    else
-      valid=1;
-    if(valid
-       && (!((a[j]<=(0+learn_parm->epsilon_a)) && (s<0)))
-       && (!((a[j]>=(learn_parm->svm_cost[j]-learn_parm->epsilon_a)) 
-	     && (s>0))) 
-       && (!chosen[j]) 
-       && (label[j])
-       && (!inconsistent[j])) 
-      {
-      selcrit[activedoc]=-(double)label[j]*(learn_parm->eps-(double)label[j]*c[j]+(double)label[j]*lin[j]);
-      /*  selcrit[activedoc]=-(double)(label[j]*(-1.0+(double)label[j]*lin[j])); */
-      key[activedoc]=j;
-      activedoc++;
-    }
-  }
-  select_top_n(selcrit,activedoc,select,(long)(qp_size/2));
-  for(k=0;(choosenum<qp_size) && (k<(qp_size/2)) && (k<activedoc);k++) {
+  /* The examples chosen above are still among the candidates for the
+     other direction, so look at that many more and skip them. */
+  select_top_n(selcritup,up,select,(long)(qp_size/2)+choosenum);
+  upsel=minl(up,(long)(qp_size/2)+choosenum);
+  for(k=0,j=0;(choosenum<qp_size) && (j<(qp_size/2)) && (k<upsel);k++) {
     /* if(learn_parm->biased_hyperplane || (selcrit[select[k]] > 0)) { */
-      i=key[select[k]];
+      i=keyup[select[k]];
+      if(chosen[i])
+	continue;
       chosen[i]=1;
       working2dnum[inum+choosenum]=i;
       choosenum+=1;
+      j++;
       if(kernel_cache)
 	kernel_cache_touch(kernel_cache,i); /* make sure it does not get
 					       kicked out of cache */
@@ -3137,6 +3578,112 @@ long select_next_qp_subproblem_rand(long int *label,
   return(choosenum);
 }
 
+long select_next_qp_pair(DOC **docs, long int *label, double *a, 
+			 double *lin, double *c, long int totdoc, 
+			 LEARN_PARM *learn_parm, long int *inconsistent, 
+			 long int *active2dnum, long int *working2dnum, 
+			 KERNEL_CACHE *kernel_cache, KERNEL_PARM *kernel_parm,
+			 double *kdiag, CFLOAT *aicache, long int *chosen,
+			 long *kernel_evals)
+     /* Select a working set of two variables for SMO using second
+	order information (Fan, Chen, Lin, 2005). The first variable
+	is the one that violates the KT-conditions most, the second is
+	the one which together with the first gives the largest
+	decrease of the objective. Without the equality constraint
+	(biased_hyperplane=0) the single most violating variable is
+	selected. Leaves the row of the first variable in aicache. */
+{
+  long i,j,t,ii,evals;
+  double grad,g,gmax,diff,quad,obj,objmin;
+  DOC *ex;
+
+  working2dnum[0]=-1;
+  i=-1;
+  gmax=0;
+  for(ii=0;(t=active2dnum[ii])>=0;ii++) {
+    if((!label[t]) || inconsistent[t])
+      continue;
+    grad=learn_parm->eps-(double)label[t]*c[t]+(double)label[t]*lin[t];
+    if(learn_parm->biased_hyperplane) {
+      if(!(((label[t]>0) 
+	    && (a[t]<(learn_parm->svm_cost[t]-learn_parm->epsilon_a)))
+	   || ((label[t]<0) && (a[t]>(0+learn_parm->epsilon_a)))))
+	continue;
+      g=-(double)label[t]*grad;
+      if((i<0) || (g>gmax)) {
+	gmax=g;
+	i=t;
+      }
+    }
+    else {
+      if((grad<0) 
+	 && (a[t]<(learn_parm->svm_cost[t]-learn_parm->epsilon_a))) 
+	g=-grad;
+      else if((grad>0) && (a[t]>(0+learn_parm->epsilon_a)))
+	g=grad;
+      else
+	continue;
+      if(g>gmax) {
+	gmax=g;
+	i=t;
+      }
+    }
+  }
+  if(i<0)
+    return(0);
+  if(!learn_parm->biased_hyperplane) {
+    chosen[i]=1;
+    working2dnum[0]=i;
+    working2dnum[1]=-1;
+    return(1);
+  }
+
+  if(kernel_cache) {
+    cache_kernel_row(kernel_cache,docs,i,kernel_parm,kernel_evals);
+    get_kernel_row(kernel_cache,docs,i,totdoc,active2dnum,aicache,
+		   kernel_parm,kernel_evals);
+  }
+  else {
+    ex=docs[i];
+    evals=0;
+    for(ii=0;(t=active2dnum[ii])>=0;ii++) 
+      aicache[t]=kernel_nostat(kernel_parm,ex,docs[t],&evals);
+    count_kernel_evals(kernel_evals,evals);
+  }
+
+  j=-1;
+  objmin=0;
+  for(ii=0;(t=active2dnum[ii])>=0;ii++) {
+    if((!label[t]) || inconsistent[t])
+      continue;
+    if(!(((label[t]>0) && (a[t]>(0+learn_parm->epsilon_a)))
+	 || ((label[t]<0) 
+	     && (a[t]<(learn_parm->svm_cost[t]-learn_parm->epsilon_a)))))
+      continue;
+    grad=learn_parm->eps-(double)label[t]*c[t]+(double)label[t]*lin[t];
+    diff=gmax+(double)label[t]*grad;
+    if(diff<=0)
+      continue;
+    quad=kdiag[i]+kdiag[t]-2.0*aicache[t];
+    if(quad<=0)
+      quad=SMO_TAU;
+    obj=-(diff*diff)/quad;
+    if((j<0) || (obj<objmin)) {
+      objmin=obj;
+      j=t;
+    }
+  }
+  if(j<0)
+    return(0);
+
+  chosen[i]=1;
+  chosen[j]=1;
+  working2dnum[0]=i;
+  working2dnum[1]=j;
+  working2dnum[2]=-1;
+  return(2);
+}
+
 long select_next_qp_slackset(DOC **docs, long int *label, 
 			     double *a, double *lin, 
 			     double *slack, double *alphaslack, 
@@ -3168,37 +3715,58 @@ long select_next_qp_slackset(DOC **docs, long int *label,
 }
 
 
+static int select_worse(double *selcrit, long int a, long int b)
+     /* true if a ranks behind b, ties rank by increasing index */
+{
+  return((selcrit[a] < selcrit[b]) || ((selcrit[a] == selcrit[b]) && (a > b)));
+}
+
+static void select_sift_down(double *selcrit, long int *heap, long int m,
+			     long int k)
+{
+  long child,tmp;
+
+  while((child=2*k+1) < m) {
+    if((child+1 < m) && select_worse(selcrit,heap[child+1],heap[child]))
+      child++;
+    if(!select_worse(selcrit,heap[child],heap[k]))
+      break;
+    tmp=heap[k]; heap[k]=heap[child]; heap[child]=tmp;
+    k=child;
+  }
+}
+
 void select_top_n(double *selcrit, long int range, long int *select, 
 		  long int n)
+     /* Writes the indices of the n largest elements of selcrit to
+	select, largest first and ties by increasing index. The n best
+	elements seen so far are kept in a heap with the worst of them
+	at the root, so this takes O(range*log(n)) time. */
 {
-  register long i,j;
-
-  for(i=0;(i<n) && (i<range);i++) { /* Initialize with the first n elements */
-    for(j=i;j>=0;j--) {
-      if((j>0) && (selcrit[select[j-1]]<selcrit[i])){
-	select[j]=select[j-1];
-      }
-      else {
-	select[j]=i;
-	j=-1;
+  register long i,k,m,tmp;
+
+  if(n>range) 
+    n=range;
+  if(n<=0) 
+    return;
+  for(i=0,m=0;i<range;i++) {
+    if(m<n) {                 /* fill the heap with the first n */
+      k=m++;
+      select[k]=i;
+      while((k>0) && select_worse(selcrit,select[k],select[(k-1)/2])) {
+	tmp=select[k]; select[k]=select[(k-1)/2]; select[(k-1)/2]=tmp;
+	k=(k-1)/2;
       }
     }
-  }
-  if(n>0) {
-    for(i=n;i<range;i++) {  
-      if(selcrit[i]>selcrit[select[n-1]]) {
-	for(j=n-1;j>=0;j--) {
-	  if((j>0) && (selcrit[select[j-1]]<selcrit[i])) {
-	    select[j]=select[j-1];
-	  }
-	  else {
-	    select[j]=i;
-	    j=-1;
-	  }
-	}
-      }
+    else if(selcrit[i]>selcrit[select[0]]) { /* replace the worst */
+      select[0]=i;
+      select_sift_down(selcrit,select,m,0);
     }
   }
+  for(k=m-1;k>0;k--) {        /* move the worst to the back */
+    tmp=select[0]; select[0]=select[k]; select[k]=tmp;
+    select_sift_down(selcrit,select,k,0);
+  }
 }      
       
 
@@ -3212,8 +3780,14 @@ void init_shrink_state(SHRINK_STATE *shrink_state, long int totdoc,
   shrink_state->deactnum=0;
   shrink_state->active = (long *)my_malloc(sizeof(long)*totdoc);
   shrink_state->inactive_since = (long *)my_malloc(sizeof(long)*totdoc);
-  shrink_state->a_history = (double **)my_malloc(sizeof(double *)*maxhistory);
   shrink_state->maxhistory=maxhistory;
+  shrink_state->a_snapshot = (double *)my_malloc(sizeof(double)*totdoc);
+  shrink_state->firsthistory=0;
+  shrink_state->undo_start = (long *)my_malloc(sizeof(long)*(maxhistory+1));
+  shrink_state->undo_index=NULL;
+  shrink_state->undo_a=NULL;
+  shrink_state->undonum=0;
+  shrink_state->undomax=0;
   shrink_state->last_lin = (double *)my_malloc(sizeof(double)*totdoc);
   shrink_state->last_a = (double *)my_malloc(sizeof(double)*totdoc);
 
@@ -3229,13 +3803,98 @@ void shrink_state_cleanup(SHRINK_STATE *shrink_state)
 {
   free(shrink_state->active);
   free(shrink_state->inactive_since);
-  if(shrink_state->deactnum > 0) 
-    free(shrink_state->a_history[shrink_state->deactnum-1]);
-  free(shrink_state->a_history);
+  free(shrink_state->a_snapshot);
+  free(shrink_state->undo_start);
+  free(shrink_state->undo_index);
+  free(shrink_state->undo_a);
   free(shrink_state->last_a);
   free(shrink_state->last_lin);
 }
 
+void shrink_state_reset(SHRINK_STATE *shrink_state, long int totdoc)
+     /* Make all variables active again and forget the shrinking
+	history, leaving the state as after init_shrink_state. */
+{
+  long i;
+
+  shrink_state->deactnum=0;
+  shrink_state->firsthistory=0;
+  shrink_state->undonum=0;
+  for(i=0;i<totdoc;i++) { 
+    shrink_state->active[i]=1;
+    shrink_state->inactive_since[i]=0;
+    shrink_state->last_a[i]=0;
+    shrink_state->last_lin[i]=0;
+  }
+}
+
+void init_solver_context(SOLVER_CONTEXT *solver)
+{
+  solver->qp_solver=qp_solver_init();
+  solver->switchsens=0.0;
+  solver->switchsensorg=0.0;
+  solver->switchnum=0;
+  solver->kernel_evals=0;
+}
+
+void solver_context_cleanup(SOLVER_CONTEXT *solver)
+{
+  qp_solver_cleanup(solver->qp_solver);
+}
+
+long shrink_history_save(SHRINK_STATE *shrink_state, double *a, 
+			 long int totdoc, long int maxentries)
+     /* Remember the alphas of the current shrinking step for
+	reactivation with a non-linear kernel. Only the alphas that
+	changed since the previous step are logged together with their
+	old value, so that walking the log backwards restores every
+	earlier step exactly. Returns 0 and saves nothing, if the log
+	would grow beyond maxentries. */
+{
+  long i,num;
+  double *a_snap;
+
+  a_snap=shrink_state->a_snapshot;
+  if(shrink_state->deactnum == 0) { /* first step needs no log */
+    for(i=0;i<totdoc;i++) {
+      a_snap[i]=a[i];
+    }
+    shrink_state->firsthistory=0;
+    shrink_state->undonum=0;
+    return(1);
+  }
+  num=shrink_state->undonum;
+  for(i=0;i<totdoc;i++) {
+    if(a[i] != a_snap[i]) 
+      num++;
+  }
+  if(num > maxentries) 
+    return(0);
+  if(num > shrink_state->undomax) {
+    shrink_state->undomax=minl(maxl(num,2*shrink_state->undomax),maxentries);
+    shrink_state->undo_index=(long *)realloc(shrink_state->undo_index,
+				   sizeof(long)*shrink_state->undomax);
+    shrink_state->undo_a=(double *)realloc(shrink_state->undo_a,
+				   sizeof(double)*shrink_state->undomax);
+    if((!shrink_state->undo_index) || (!shrink_state->undo_a)) {
+      perror ("Out of memory!\n"); 
+      exit (1); 
+    }
+  }
+  num=shrink_state->undonum;
+  shrink_state->undo_start[shrink_state->deactnum]=num;
+  for(i=0;i<totdoc;i++) {
+    if(a[i] != a_snap[i]) {
+      shrink_state->undo_index[num]=i;
+      shrink_state->undo_a[num]=a_snap[i];
+      num++;
+      a_snap[i]=a[i];
+    }
+  }
+  shrink_state->undonum=num;
+  return(1);
+}
+
 long shrink_problem(DOC **docs,
 		    LEARN_PARM *learn_parm, 
 		    SHRINK_STATE *shrink_state, 
@@ -3250,8 +3909,7 @@ long shrink_problem(DOC **docs,
      /* Shrink some variables away.  Do the shrinking only if at least
         minshrink variables can be removed. */
 {
-  long i,ii,change,activenum,lastiter;
-  double *a_old;
+  long i,ii,change,activenum,lastiter,maxentries;
   
   activenum=0;
   change=0;
@@ -3267,20 +3925,17 @@ long shrink_problem(DOC **docs,
       change++;
     }
   }
+  maxentries=(long)((double)learn_parm->shrink_history_size*1024.0*1024.0
+		    /(sizeof(long)+sizeof(double)));
   if((change>=minshrink) /* shrink only if sufficiently many candidates */
-     && (shrink_state->deactnum<shrink_state->maxhistory)) { /* and enough memory */
+     && (shrink_state->deactnum<shrink_state->maxhistory) /* and enough memory */
+     && ((kernel_parm->kernel_type == LINEAR)  /* non-linear case save alphas */
+	 || shrink_history_save(shrink_state,a,totdoc,maxentries))) {
     /* Shrink problem by removing those variables which are */
     /* optimal at a bound for a minimum number of iterations */
     if(verbosity>=2) {
       printf(" Shrinking..."); fflush(stdout);
     }
-    if(kernel_parm->kernel_type != LINEAR) { /*  non-linear case save alphas */
-      a_old=(double *)my_malloc(sizeof(double)*totdoc);
-      shrink_state->a_history[shrink_state->deactnum]=a_old;
-      for(i=0;i<totdoc;i++) {
-	a_old[i]=a[i];
-      }
-    }
     for(ii=0;active2dnum[ii]>=0;ii++) {
       i=active2dnum[ii];
       if(learn_parm->sharedslack)
@@ -3323,33 +3978,37 @@ void reactivate_inactive_examples(long int *label,
 				  KERNEL_CACHE *kernel_cache, 
 				  MODEL *model, 
 				  CFLOAT *aicache, 
-				  double *weights, 
-				  double *maxdiff)
+				  SPARSE_ACCU *weights, 
+				  double *maxdiff,
+				  long *kernel_evals)
      /* Make all variables active again which had been removed by
         shrinking. */
      /* Computes lin for those variables from scratch. */
 {
   register long i,j,ii,jj,t,*changed2dnum,*inactive2dnum;
-  long *changed,*inactive;
+  long *changed,*inactive,k,end,changednum,inactnum,b,blocknum,blockmax;
   register double kernel_val,*a_old,dist;
   double ex_c,target;
+  CFLOAT *block;
   SVECTOR *f;
 
   if(kernel_parm->kernel_type == LINEAR) { /* special linear case */
     a_old=shrink_state->last_a;    
-    clear_vector_n(weights,totwords);
+    sparse_accu_clear(weights);
     for(i=0;i<totdoc;i++) {
       if(a[i] != a_old[i]) {
 	for(f=docs[i]->fvec;f;f=f->next)  
-	  add_vector_ns(weights,f,
-			f->factor*((a[i]-a_old[i])*(double)label[i]));
+	  sparse_accu_add(weights,f,
+			  f->factor*((a[i]-a_old[i])*(double)label[i]));
 	a_old[i]=a[i];
       }
     }
+    sparse_accu_compact(weights);
+#pragma omp parallel for private(f) schedule(static) if(totdoc>=KERNEL_PAR_MIN)
     for(i=0;i<totdoc;i++) {
       if(!shrink_state->active[i]) {
 	for(f=docs[i]->fvec;f;f=f->next)  
-	  lin[i]=shrink_state->last_lin[i]+f->factor*sprod_ns(weights,f);
+	  lin[i]=shrink_state->last_lin[i]+f->factor*sparse_accu_sprod(weights,f);
       }
       shrink_state->last_lin[i]=lin[i];
     }
@@ -3359,25 +4018,48 @@ void reactivate_inactive_examples(long int *label,
     changed2dnum=(long *)my_malloc(sizeof(long)*(totdoc+11));
     inactive=(long *)my_malloc(sizeof(long)*totdoc);
     inactive2dnum=(long *)my_malloc(sizeof(long)*(totdoc+11));
-    for(t=shrink_state->deactnum-1;(t>=0) && shrink_state->a_history[t];t--) {
+    blockmax=maxl(totdoc,minl(REACTIVATE_BLOCK*totdoc,REACTIVATE_BLOCK_MAX));
+    block=(CFLOAT *)my_malloc(sizeof(CFLOAT)*blockmax);
+    a_old=shrink_state->a_snapshot;    
+    for(t=shrink_state->deactnum-1;t>=shrink_state->firsthistory;t--) {
       if(verbosity>=2) {
 	printf("%ld..",t); fflush(stdout);
       }
-      a_old=shrink_state->a_history[t];    
       for(i=0;i<totdoc;i++) {
 	inactive[i]=((!shrink_state->active[i]) 
 		     && (shrink_state->inactive_since[i] == t));
 	changed[i]= (a[i] != a_old[i]);
       }
-      compute_index(inactive,totdoc,inactive2dnum);
-      compute_index(changed,totdoc,changed2dnum);
+      inactnum=compute_index(inactive,totdoc,inactive2dnum);
+      changednum=compute_index(changed,totdoc,changed2dnum);
       
-      for(ii=0;(i=changed2dnum[ii])>=0;ii++) {
-	get_kernel_row(kernel_cache,docs,i,totdoc,inactive2dnum,aicache,
-		       kernel_parm);
-	for(jj=0;(j=inactive2dnum[jj])>=0;jj++) {
-	  kernel_val=aicache[j];
-	  lin[j]+=(((a[i]*kernel_val)-(a_old[i]*kernel_val))*(double)label[i]);
+      /* The kernel rows of a block of changed variables are computed
+	 together and then used by all threads, each updating lin for
+	 its share of the inactive variables. Every lin[j] still sums
+	 the rows in the same order as one row at a time did. */
+      blocknum=maxl(1,minl(REACTIVATE_BLOCK,blockmax/maxl(inactnum,1)));
+      for(b=0;b<changednum;b+=blocknum) {
+	k=minl(blocknum,changednum-b);
+	get_kernel_block(kernel_cache,docs,changed2dnum+b,k,
+			 inactive2dnum,inactnum,block,kernel_parm,
+			 kernel_evals);
+#pragma omp parallel for private(i,j,ii,kernel_val) schedule(static) if(k*inactnum>=KERNEL_PAR_MIN)
+	for(jj=0;jj<inactnum;jj++) {
+	  j=inactive2dnum[jj];
+	  for(ii=0;ii<k;ii++) {
+	    i=changed2dnum[b+ii];
+	    kernel_val=block[ii*inactnum+jj];
+	    lin[j]+=(((a[i]*kernel_val)-(a_old[i]*kernel_val))*(double)label[i]);
+	  }
+	}
+      }
+      if(t > shrink_state->firsthistory) { /* step back to alphas of t-1 */
+	if(t+1 < shrink_state->deactnum) 
+	  end=shrink_state->undo_start[t+1];
+	else
+	  end=shrink_state->undonum;
+	for(k=shrink_state->undo_start[t];k<end;k++) {
+	  a_old[shrink_state->undo_index[k]]=shrink_state->undo_a[k];
 	}
       }
     }
@@ -3385,6 +4067,7 @@ void reactivate_inactive_examples(long int *label,
     free(changed2dnum);
     free(inactive);
     free(inactive2dnum);
+    free(block);
   }
   (*maxdiff)=0;
   for(i=0;i<totdoc;i++) {
@@ -3419,93 +4102,304 @@ void reactivate_inactive_examples(long int *label,
   }
   if(kernel_parm->kernel_type != LINEAR) { /* update history for non-linear */
     for(i=0;i<totdoc;i++) {
-      (shrink_state->a_history[shrink_state->deactnum-1])[i]=a[i];
-    }
-    for(t=shrink_state->deactnum-2;(t>=0) && shrink_state->a_history[t];t--) {
-      free(shrink_state->a_history[t]);
-      shrink_state->a_history[t]=0;
+      shrink_state->a_snapshot[i]=a[i];
     }
+    shrink_state->firsthistory=shrink_state->deactnum-1;
+    shrink_state->undonum=0;
   }
 }
 
 /****************************** Cache handling *******************************/
 
+void count_kernel_evals(long *kernel_evals, long n)
+     /* Adds n kernel evaluations to the counter of the training run
+	and to the total of the process in kernel_cache_statistic. The
+	counter of the run must only be updated by the thread running
+	it. */
+{
+  if(kernel_evals) 
+    (*kernel_evals)+=n;
+#pragma omp atomic
+  kernel_cache_statistic+=n;
+}
+
 void get_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs, 
 		    long int docnum, long int totdoc, 
 		    long int *active2dnum, CFLOAT *buffer, 
-		    KERNEL_PARM *kernel_parm)
+		    KERNEL_PARM *kernel_parm, long *kernel_evals)
      /* Get's a row of the matrix of kernel values This matrix has the
       same form as the Hessian, just that the elements are not
       multiplied by */
      /* y_i * y_j * a_i * a_j */
-     /* Takes the values from the cache if available. */
+     /* Takes the values from the cache if available. kernel_cache
+	may be NULL. */
+     /* The row is computed by all threads, if it is long enough. */
 {
-  register long i,j,start;
+  long i,j,n,start=-1,evals=0;
   DOC *ex;
 
   ex=docs[docnum];
 
-  if(kernel_cache->index[docnum] != -1) { /* row is cached? */
-    kernel_cache->lru[kernel_cache->index[docnum]]=kernel_cache->time; /* lru */
-    start=kernel_cache->activenum*kernel_cache->index[docnum];
-    for(i=0;(j=active2dnum[i])>=0;i++) {
-      if(kernel_cache->totdoc2active[j] >= 0) { /* column is cached? */
-	buffer[j]=kernel_cache->buffer[start+kernel_cache->totdoc2active[j]];
+  for(n=0;active2dnum[n]>=0;n++);
+
+  if(kernel_parm->kernel_type == PRECOMPUTED) { /* the matrix is the cache */
+    float *row=gram_row(kernel_parm,docnum);
+    for(i=0;i<n;i++) {
+      j=active2dnum[i];
+      buffer[j]=row[j % kernel_parm->gram_n];
+    }
+    count_kernel_evals(kernel_evals,n);
+    return;
+  }
+
+  if(!kernel_cache) {
+    /* nothing cached, the whole row is computed */
+  }
+  else if(kernel_cache->index[docnum] != -1) { /* row is cached? */
+    start=kernel_cache->rowlen*kernel_cache->index[docnum];
+    if(!kernel_cache->readonly) {
+      kernel_cache_touch(kernel_cache,docnum); /* lru */
+      kernel_cache->hits++;
+    }
+  }
+  else if(!kernel_cache->readonly) {
+    kernel_cache->misses++;
+  }
+
+#pragma omp parallel for private(j) reduction(+:evals) if(n>=KERNEL_PAR_MIN)
+  for(i=0;i<n;i++) {
+    j=active2dnum[i];
+    if((start != -1) && (kernel_cache->totdoc2active[j] >= 0)) { 
+      /* column is cached? */
+      buffer[j]=KFLOAT_LOAD(kernel_cache->buffer[start
+					       +kernel_cache->totdoc2active[j]]);
+    }
+    else {
+      buffer[j]=(CFLOAT)kernel_nostat(kernel_parm,ex,docs[j],&evals);
+    }
+  }
+  count_kernel_evals(kernel_evals,evals);
+}
+
+void get_kernel_block(KERNEL_CACHE *kernel_cache, DOC **docs, 
+		      long int *rows, long int rownum, 
+		      long int *cols, long int colnum, CFLOAT *buffer, 
+		      KERNEL_PARM *kernel_parm, long *kernel_evals)
+     /* Gets the kernel values of the documents in rows against those
+	in cols. The values of row b are stored in
+	buffer[b*colnum..(b+1)*colnum-1]. Like get_kernel_row, the
+	values are taken from the cache if available. The cache
+	bookkeeping is done first, then the whole block is computed by
+	all threads. */
+{
+  long b,k,j,*start,evals=0;
+  float *row;
+
+  start=(long *)my_malloc(sizeof(long)*(rownum+1));
+  for(b=0;b<rownum;b++) {
+    start[b]=-1;
+    if((!kernel_cache)
+       || (kernel_parm->kernel_type == PRECOMPUTED)) /* the matrix is the cache */
+      continue;
+    if(kernel_cache->index[rows[b]] != -1) { /* row is cached? */
+      start[b]=kernel_cache->rowlen*kernel_cache->index[rows[b]];
+      if(!kernel_cache->readonly) {
+	kernel_cache_touch(kernel_cache,rows[b]); /* lru */
+	kernel_cache->hits++;
+      }
+    }
+    else if(!kernel_cache->readonly) {
+      kernel_cache->misses++;
+    }
+  }
+
+#pragma omp parallel for collapse(2) private(j,row) reduction(+:evals) if(rownum*colnum>=KERNEL_PAR_MIN)
+  for(b=0;b<rownum;b++) {
+    for(k=0;k<colnum;k++) {
+      j=cols[k];
+      if(kernel_parm->kernel_type == PRECOMPUTED) {
+	row=gram_row(kernel_parm,rows[b]);
+	buffer[b*colnum+k]=row[j % kernel_parm->gram_n];
+	evals++;
+      }
+      else if((start[b] != -1) && (kernel_cache->totdoc2active[j] >= 0)) { 
+	/* column is cached? */
+	buffer[b*colnum+k]=KFLOAT_LOAD(kernel_cache->buffer[start[b]
+					 +kernel_cache->totdoc2active[j]]);
       }
       else {
-	buffer[j]=(CFLOAT)kernel(kernel_parm,ex,docs[j]);
+	buffer[b*colnum+k]=(CFLOAT)kernel_nostat(kernel_parm,docs[rows[b]],
+						 docs[j],&evals);
       }
     }
   }
-  else {
-    for(i=0;(j=active2dnum[i])>=0;i++) {
-      buffer[j]=(CFLOAT)kernel(kernel_parm,ex,docs[j]);
-    }
+  count_kernel_evals(kernel_evals,evals);
+  free(start);
+}
+
+
+CFLOAT kernel_cache_compute_elem(KERNEL_CACHE *kernel_cache, DOC **docs,
+				 long int m, long int j,
+				 KERNEL_PARM *kernel_parm, long *evals)
+     /* Computes the element of the cache row m in the active column j,
+        taking it from the symmetric row if that one is cached and
+        completely filled. Safe to call from several threads at once
+        while the cache layout is not modified. */
+{
+  long k,l;
+
+  k=kernel_cache->active2totdoc[j];
+  if(k < 0) {  /* removed column, never read */
+    return(0);
+  }
+  l=kernel_cache->totdoc2active[m];
+  if((kernel_cache->index[k] != -1) && (l != -1) && (k != m)
+     && (kernel_cache->occu[kernel_cache->index[k]] == 1)) {
+    return(KFLOAT_LOAD(kernel_cache->buffer[kernel_cache->rowlen
+					    *kernel_cache->index[k]+l]));
   }
+  return((CFLOAT)kernel_nostat(kernel_parm,docs[m],docs[k],evals));
+}
+
+
+double get_kernel_elem(KERNEL_CACHE *kernel_cache, DOC **docs, 
+		       long int i, long int j, KERNEL_PARM *kernel_parm,
+		       long *evals)
+     /* Returns K(i,j), taken from the cached row of i or of j if there
+	is one, otherwise it is computed. kernel_cache may be NULL. Like
+	kernel_nostat, adds the number of kernel evaluations to
+	*evals. */
+{
+  if(kernel_cache && (kernel_parm->kernel_type != PRECOMPUTED)) {
+    if((kernel_cache->index[i] != -1) 
+       && (kernel_cache->totdoc2active[j] >= 0)
+       && (kernel_cache->occu[kernel_cache->index[i]] == 1)) 
+      return((double)KFLOAT_LOAD(kernel_cache->buffer[kernel_cache->rowlen
+				*kernel_cache->index[i]
+				+kernel_cache->totdoc2active[j]]));
+    if((kernel_cache->index[j] != -1) 
+       && (kernel_cache->totdoc2active[i] >= 0)
+       && (kernel_cache->occu[kernel_cache->index[j]] == 1)) 
+      return((double)KFLOAT_LOAD(kernel_cache->buffer[kernel_cache->rowlen
+				*kernel_cache->index[j]
+				+kernel_cache->totdoc2active[i]]));
+  }
+  return(kernel_nostat(kernel_parm,docs[i],docs[j],evals));
 }
 
+double *kernel_cache_diagonal(KERNEL_CACHE *kernel_cache, DOC **docs, 
+			      long int totdoc, KERNEL_PARM *kernel_parm,
+			      long *kernel_evals)
+     /* Returns K(i,i) for all documents. They are computed in full
+	precision on the first call and kept with the cache, since the
+	cache rows do not always contain the diagonal. A read-only view
+	returns what the owner computed, possibly NULL. */
+{
+  long i,evals=0;
+  double *diag;
+
+  if(kernel_cache->diag || kernel_cache->readonly) 
+    return(kernel_cache->diag);
+  diag=(double *)my_malloc(sizeof(double)*totdoc);
+#pragma omp parallel for reduction(+:evals) if(totdoc>=KERNEL_PAR_MIN)
+  for(i=0;i<totdoc;i++) 
+    diag[i]=kernel_nostat(kernel_parm,docs[i],docs[i],&evals);
+  count_kernel_evals(kernel_evals,evals);
+  kernel_cache->diag=diag;
+  return(diag);
+}
 
 void cache_kernel_row(KERNEL_CACHE *kernel_cache, DOC **docs, 
-		      long int m, KERNEL_PARM *kernel_parm)
+		      long int m, KERNEL_PARM *kernel_parm, 
+		      long *kernel_evals)
      /* Fills cache for the row m */
 {
-  register DOC *ex;
-  register long j,k,l;
-  register CFLOAT *cache;
+  long j,evals=0;
+  KFLOAT *cache;
+
+  if((!kernel_cache) || kernel_cache->readonly) {
+    return;
+  }
 
   if(!kernel_cache_check(kernel_cache,m)) {  /* not cached yet*/
+    kernel_cache->misses++;
     cache = kernel_cache_clean_and_malloc(kernel_cache,m);
     if(cache) {
-      l=kernel_cache->totdoc2active[m];
-      ex=docs[m];
-      for(j=0;j<kernel_cache->activenum;j++) {  /* fill cache */
-	k=kernel_cache->active2totdoc[j];
-	if((kernel_cache->index[k] != -1) && (l != -1) && (k != m)) {
-	  cache[j]=kernel_cache->buffer[kernel_cache->activenum
-				       *kernel_cache->index[k]+l];
-	}
-	else {
-	  cache[j]=kernel(kernel_parm,ex,docs[k]);
-	} 
+#pragma omp parallel for reduction(+:evals) if(kernel_cache->rowlen>=KERNEL_PAR_MIN)
+      for(j=0;j<kernel_cache->rowlen;j++) {  /* fill cache */
+	cache[j]=KFLOAT_STORE(kernel_cache_compute_elem(kernel_cache,docs,m,j,
+							kernel_parm,&evals));
       }
+      count_kernel_evals(kernel_evals,evals);
     }
     else {
       perror("Error: Kernel cache full! => increase cache size");
     }
   }
+  else {
+    kernel_cache->hits++;
+  }
 }
 
  
 void cache_multiple_kernel_rows(KERNEL_CACHE *kernel_cache, DOC **docs, 
 				long int *key, long int varnum, 
-				KERNEL_PARM *kernel_parm)
+				KERNEL_PARM *kernel_parm, long *kernel_evals)
      /* Fills cache for the rows in key */
+     /* All rows are allocated first, so that the LRU bookkeeping stays
+	sequential, and then filled in parallel. Rows being filled are
+	marked with occu=2, so that they are not used as the source of
+	symmetric elements before they are complete. */
 {
-  register long i;
+  long i,j,evals=0,rowlen;
+  KFLOAT **rows;
+
+  if((!kernel_cache) || kernel_cache->readonly) {
+    return;
+  }
+
+  rows=(KFLOAT **)my_malloc(sizeof(KFLOAT *)*(varnum+1));
+  for(i=0;i<varnum;i++) {
+    rows[i]=NULL;
+    if(kernel_cache_check(kernel_cache,key[i])) {
+      kernel_cache->hits++;
+    }
+    else {  /* not cached yet*/
+      kernel_cache->misses++;
+      rows[i]=kernel_cache_clean_and_malloc(kernel_cache,key[i]);
+      if(!rows[i]) {
+	perror("Error: Kernel cache full! => increase cache size");
+      }
+    }
+  }
+  for(i=0;i<varnum;i++) {  /* a later row might have evicted this one */
+    if(rows[i] && (kernel_cache->index[key[i]] == -1)) {
+      rows[i]=NULL;
+    }
+    if(rows[i]) {
+      kernel_cache->occu[kernel_cache->index[key[i]]]=2;
+    }
+  }
+
+  rowlen=kernel_cache->rowlen;
+#pragma omp parallel for collapse(2) reduction(+:evals) if(varnum*rowlen>=KERNEL_PAR_MIN)
+  for(i=0;i<varnum;i++) {
+    for(j=0;j<rowlen;j++) {
+      if(rows[i]) {
+	rows[i][j]=KFLOAT_STORE(kernel_cache_compute_elem(kernel_cache,docs,
+							  key[i],j,kernel_parm,
+							  &evals));
+      }
+    }
+  }
+  count_kernel_evals(kernel_evals,evals);
 
-  for(i=0;i<varnum;i++) {  /* fill up kernel cache */
-    cache_kernel_row(kernel_cache,docs,key[i],kernel_parm);
+  for(i=0;i<varnum;i++) {
+    if(rows[i]) {
+      kernel_cache->occu[kernel_cache->index[key[i]]]=1;
+    }
   }
+  free(rows);
 }
 
  
@@ -3513,59 +4407,71 @@ void kernel_cache_shrink(KERNEL_CACHE *kernel_cache, long int totdoc,
 			 long int numshrink, long int *after)
      /* Remove numshrink columns in the cache which correspond to
         examples marked 0 in after. */
+     /* The columns are only marked as removed. The buffer is compacted
+	once the removed columns make up a quarter of each row, so the
+	cost of the copy is amortized over many calls. */
 {
-  register long i,j,jj,from=0,to=0,scount;  
-  long *keep;
+  long j,jj,scount;  
 
-  if(verbosity>=2) {
-    printf(" Reorganizing cache..."); fflush(stdout);
+  if(kernel_cache->readonly) {
+    return;
   }
 
-  keep=(long *)my_malloc(sizeof(long)*totdoc);
-  for(j=0;j<totdoc;j++) {
-    keep[j]=1;
-  }
   scount=0;
-  for(jj=0;(jj<kernel_cache->activenum) && (scount<numshrink);jj++) {
+  for(jj=0;(jj<kernel_cache->rowlen) && (scount<numshrink);jj++) {
     j=kernel_cache->active2totdoc[jj];
-    if(!after[j]) {
+    if((j >= 0) && (!after[j])) {
       scount++;
-      keep[j]=0;
+      kernel_cache->active2totdoc[jj]=-1;
+      kernel_cache->totdoc2active[j]=-1;
     }
   }
+  kernel_cache->activenum-=scount;
+
+  if((kernel_cache->activenum > 0)
+     && (4*(kernel_cache->rowlen-kernel_cache->activenum) 
+	 >= kernel_cache->rowlen)) {
+    kernel_cache_compact(kernel_cache,totdoc);
+  }
+}
+
+void kernel_cache_compact(KERNEL_CACHE *kernel_cache, long int totdoc)
+     /* Drop the removed columns from all cached rows. */
+{
+  long i,j,jj,to;
+  KFLOAT *from;
 
+  if(verbosity>=2) {
+    printf(" Reorganizing cache..."); fflush(stdout);
+  }
+
+  /* Rows only move towards the start of the buffer, so the copy
+     can be done in place. */
   for(i=0;i<kernel_cache->max_elems;i++) {
-    for(jj=0;jj<kernel_cache->activenum;jj++) {
-      j=kernel_cache->active2totdoc[jj];
-      if(!keep[j]) {
-	from++;
-      }
-      else {
-	kernel_cache->buffer[to]=kernel_cache->buffer[from];
-	to++;
-	from++;
+    if(!kernel_cache->occu[i]) 
+      continue;
+    from=kernel_cache->buffer+kernel_cache->rowlen*i;
+    to=kernel_cache->activenum*i;
+    for(jj=0;jj<kernel_cache->rowlen;jj++) {
+      if(kernel_cache->active2totdoc[jj] >= 0) {
+	kernel_cache->buffer[to++]=from[jj];
       }
     }
   }
 
-  kernel_cache->activenum=0;
-  for(j=0;j<totdoc;j++) {
-    if((keep[j]) && (kernel_cache->totdoc2active[j] != -1)) {
-      kernel_cache->active2totdoc[kernel_cache->activenum]=j;
-      kernel_cache->totdoc2active[j]=kernel_cache->activenum;
-      kernel_cache->activenum++;
-    }
-    else {
-      kernel_cache->totdoc2active[j]=-1;
+  for(jj=0,to=0;jj<kernel_cache->rowlen;jj++) {
+    j=kernel_cache->active2totdoc[jj];
+    if(j >= 0) {
+      kernel_cache->active2totdoc[to]=j;
+      kernel_cache->totdoc2active[j]=to;
+      to++;
     }
   }
+  kernel_cache->rowlen=kernel_cache->activenum;
 
-  kernel_cache->max_elems=(long)(kernel_cache->buffsize/kernel_cache->activenum);
-  if(kernel_cache->max_elems>totdoc) {
-    kernel_cache->max_elems=totdoc;
-  }
-
-  free(keep);
+  kernel_cache_set_max_elems(kernel_cache,
+		      minl((long)(kernel_cache->buffsize/kernel_cache->rowlen),
+			   totdoc));
 
   if(verbosity>=2) {
     printf("done.\n"); fflush(stdout);
@@ -3581,117 +4487,163 @@ KERNEL_CACHE *kernel_cache_init(long int totdoc, long int buffsize)
   kernel_cache=(KERNEL_CACHE *)my_malloc(sizeof(KERNEL_CACHE));
   kernel_cache->index = (long *)my_malloc(sizeof(long)*totdoc);
   kernel_cache->occu = (long *)my_malloc(sizeof(long)*totdoc);
-  kernel_cache->lru = (long *)my_malloc(sizeof(long)*totdoc);
+  kernel_cache->lru_prev = (long *)my_malloc(sizeof(long)*totdoc);
+  kernel_cache->lru_next = (long *)my_malloc(sizeof(long)*totdoc);
+  kernel_cache->free_slots = (long *)my_malloc(sizeof(long)*totdoc);
   kernel_cache->invindex = (long *)my_malloc(sizeof(long)*totdoc);
   kernel_cache->active2totdoc = (long *)my_malloc(sizeof(long)*totdoc);
   kernel_cache->totdoc2active = (long *)my_malloc(sizeof(long)*totdoc);
-  kernel_cache->buffer = (CFLOAT *)my_malloc((size_t)(buffsize)*1024*1024);
-
-  kernel_cache->buffsize=(long)(buffsize/sizeof(CFLOAT)*1024*1024);
+  kernel_cache->buffer = (KFLOAT *)my_malloc((size_t)(buffsize)*1024*1024);
 
-  kernel_cache->max_elems=(long)(kernel_cache->buffsize/totdoc);
-  if(kernel_cache->max_elems>totdoc) {
-    kernel_cache->max_elems=totdoc;
-  }
+  kernel_cache->buffsize=(long)((size_t)(buffsize)*1024*1024/sizeof(KFLOAT));
 
   if(verbosity>=2) {
-    printf(" Cache-size in rows = %ld\n",kernel_cache->max_elems);
     printf(" Kernel evals so far: %ld\n",kernel_cache_statistic);    
   }
 
   kernel_cache->elems=0;   /* initialize cache */
+  kernel_cache->lru_head=-1;
+  kernel_cache->lru_tail=-1;
+  kernel_cache->free_num=0;
+  kernel_cache->max_elems=0;
   for(i=0;i<totdoc;i++) {
     kernel_cache->index[i]=-1;
-    kernel_cache->lru[i]=0;
-  }
-  for(i=0;i<totdoc;i++) {
     kernel_cache->occu[i]=0;
     kernel_cache->invindex[i]=-1;
   }
+  kernel_cache_set_max_elems(kernel_cache,
+			     minl((long)(kernel_cache->buffsize/totdoc),totdoc));
 
-  kernel_cache->activenum=totdoc;;
+  kernel_cache->activenum=totdoc;
+  kernel_cache->rowlen=totdoc;
   for(i=0;i<totdoc;i++) {
       kernel_cache->active2totdoc[i]=i;
       kernel_cache->totdoc2active[i]=i;
   }
 
-  kernel_cache->time=0;  
+  kernel_cache->hits=0;
+  kernel_cache->misses=0;
+  kernel_cache->evictions=0;
+  kernel_cache->readonly=0;
+  kernel_cache->diag=NULL;
+
+  if(verbosity>=2) {
+    printf(" Cache-size in rows = %ld\n",kernel_cache->max_elems);
+  }
 
   return(kernel_cache);
 } 
 
-void kernel_cache_reset_lru(KERNEL_CACHE *kernel_cache)
+void kernel_cache_set_max_elems(KERNEL_CACHE *kernel_cache, long int max_elems)
+     /* Changes the number of rows the cache can hold. Rows beyond the
+	new limit are dropped, new rows are pushed onto the free stack. */
 {
-  long maxlru=0,k;
-  
-  for(k=0;k<kernel_cache->max_elems;k++) {
-    if(maxlru < kernel_cache->lru[k]) 
-      maxlru=kernel_cache->lru[k];
+  long i,k;
+
+  if(max_elems < kernel_cache->max_elems) {
+    for(i=max_elems;i<kernel_cache->max_elems;i++) {
+      if(kernel_cache->occu[i]) {
+	kernel_cache_lru_unlink(kernel_cache,i);
+	kernel_cache->index[kernel_cache->invindex[i]]=-1;
+	kernel_cache->invindex[i]=-1;
+	kernel_cache->occu[i]=0;
+	kernel_cache->elems--;
+      }
+    }
+    for(i=0,k=0;i<kernel_cache->free_num;i++) {
+      if(kernel_cache->free_slots[i] < max_elems) {
+	kernel_cache->free_slots[k++]=kernel_cache->free_slots[i];
+      }
+    }
+    kernel_cache->free_num=k;
   }
-  for(k=0;k<kernel_cache->max_elems;k++) {
-      kernel_cache->lru[k]-=maxlru;
+  else {
+    /* push in reverse, so that low rows are handed out first */
+    for(i=max_elems-1;i>=kernel_cache->max_elems;i--) {
+      kernel_cache->free_slots[kernel_cache->free_num++]=i;
+    }
   }
+  kernel_cache->max_elems=max_elems;
 }
 
 void kernel_cache_cleanup(KERNEL_CACHE *kernel_cache)
 {
   free(kernel_cache->index);
   free(kernel_cache->occu);
-  free(kernel_cache->lru);
+  free(kernel_cache->lru_prev);
+  free(kernel_cache->lru_next);
+  free(kernel_cache->free_slots);
   free(kernel_cache->invindex);
   free(kernel_cache->active2totdoc);
   free(kernel_cache->totdoc2active);
   free(kernel_cache->buffer);
+  if(kernel_cache->diag)
+    free(kernel_cache->diag);
   free(kernel_cache);
 }
 
+void kernel_cache_lru_unlink(KERNEL_CACHE *kernel_cache, long int i)
+     /* remove row i from the lru list */
+{
+  long prev=kernel_cache->lru_prev[i],next=kernel_cache->lru_next[i];
+
+  if(prev != -1) kernel_cache->lru_next[prev]=next;
+  else kernel_cache->lru_head=next;
+  if(next != -1) kernel_cache->lru_prev[next]=prev;
+  else kernel_cache->lru_tail=prev;
+}
+
+void kernel_cache_lru_append(KERNEL_CACHE *kernel_cache, long int i)
+     /* make row i the most recently used one */
+{
+  kernel_cache->lru_prev[i]=kernel_cache->lru_tail;
+  kernel_cache->lru_next[i]=-1;
+  if(kernel_cache->lru_tail != -1) 
+    kernel_cache->lru_next[kernel_cache->lru_tail]=i;
+  else 
+    kernel_cache->lru_head=i;
+  kernel_cache->lru_tail=i;
+}
+
 long kernel_cache_malloc(KERNEL_CACHE *kernel_cache)
 {
   long i;
 
   if(kernel_cache_space_available(kernel_cache)) {
-    for(i=0;i<kernel_cache->max_elems;i++) {
-      if(!kernel_cache->occu[i]) {
-	kernel_cache->occu[i]=1;
-	kernel_cache->elems++;
-	return(i);
-      }
-    }
+    i=kernel_cache->free_slots[--kernel_cache->free_num];
+    kernel_cache->occu[i]=1;
+    kernel_cache->elems++;
+    kernel_cache_lru_append(kernel_cache,i);
+    return(i);
   }
   return(-1);
 }
 
 void kernel_cache_free(KERNEL_CACHE *kernel_cache, long int i)
 {
+  kernel_cache_lru_unlink(kernel_cache,i);
   kernel_cache->occu[i]=0;
+  kernel_cache->free_slots[kernel_cache->free_num++]=i;
   kernel_cache->elems--;
 }
 
 long kernel_cache_free_lru(KERNEL_CACHE *kernel_cache) 
      /* remove least recently used cache element */
 {                                     
-  register long k,least_elem=-1,least_time;
-
-  least_time=kernel_cache->time+1;
-  for(k=0;k<kernel_cache->max_elems;k++) {
-    if(kernel_cache->invindex[k] != -1) {
-      if(kernel_cache->lru[k]<least_time) {
-	least_time=kernel_cache->lru[k];
-	least_elem=k;
-      }
-    }
-  }
+  long least_elem=kernel_cache->lru_head;
+
   if(least_elem != -1) {
-    kernel_cache_free(kernel_cache,least_elem);
     kernel_cache->index[kernel_cache->invindex[least_elem]]=-1;
     kernel_cache->invindex[least_elem]=-1;
+    kernel_cache_free(kernel_cache,least_elem);
+    kernel_cache->evictions++;
     return(1);
   }
   return(0);
 }
 
 
-CFLOAT *kernel_cache_clean_and_malloc(KERNEL_CACHE *kernel_cache, 
+KFLOAT *kernel_cache_clean_and_malloc(KERNEL_CACHE *kernel_cache, 
 				      long int docnum)
      /* Get a free cache entry. In case cache is full, the lru element
         is removed. */
@@ -3707,17 +4659,18 @@ CFLOAT *kernel_cache_clean_and_malloc(KERNEL_CACHE *kernel_cache,
     return(0);
   }
   kernel_cache->invindex[result]=docnum;
-  kernel_cache->lru[kernel_cache->index[docnum]]=kernel_cache->time; /* lru */
-  return((CFLOAT *)((long)kernel_cache->buffer
-		    +(kernel_cache->activenum*sizeof(CFLOAT)*
+  return((KFLOAT *)((long)kernel_cache->buffer
+		    +(kernel_cache->rowlen*sizeof(KFLOAT)*
 		      kernel_cache->index[docnum])));
 }
 
 long kernel_cache_touch(KERNEL_CACHE *kernel_cache, long int docnum)
      /* Update lru time to avoid removal from cache. */
 {
-  if(kernel_cache && kernel_cache->index[docnum] != -1) {
-    kernel_cache->lru[kernel_cache->index[docnum]]=kernel_cache->time; /* lru */
+  if(kernel_cache && (!kernel_cache->readonly)
+     && kernel_cache->index[docnum] != -1) {
+    kernel_cache_lru_unlink(kernel_cache,kernel_cache->index[docnum]);
+    kernel_cache_lru_append(kernel_cache,kernel_cache->index[docnum]);
     return(1);
   }
   return(0);
@@ -3734,6 +4687,14 @@ long kernel_cache_space_available(KERNEL_CACHE *kernel_cache)
 {
   return(kernel_cache->elems < kernel_cache->max_elems);
 }
+
+void kernel_cache_print_statistic(KERNEL_CACHE *kernel_cache)
+{
+  if(kernel_cache) {
+    printf("Kernel cache rows: %ld hits, %ld misses, %ld evictions\n",
+	   kernel_cache->hits,kernel_cache->misses,kernel_cache->evictions);
+  }
+}
   
 /************************** Compute estimates ******************************/
 
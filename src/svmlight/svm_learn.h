@@ -31,14 +31,16 @@ void   svm_learn_optimization(DOC **, double *, long, long, LEARN_PARM *,
 			      double *);
 long   optimize_to_convergence(DOC **, long *, long, long, LEARN_PARM *,
 			       KERNEL_PARM *, KERNEL_CACHE *, SHRINK_STATE *,
-			       MODEL *, long *, long *, double *,
-			       double *, double *,
+			       SOLVER_CONTEXT *, MODEL *, long *, long *, 
+			       double *, double *, double *,
 			       TIMING *, double *, long, long);
 long   optimize_to_convergence_sharedslack(DOC **, long *, long, long, 
 			       LEARN_PARM *,
 			       KERNEL_PARM *, KERNEL_CACHE *, SHRINK_STATE *,
-			       MODEL *, double *, double *, double *,
-			       TIMING *, double *);
+			       SOLVER_CONTEXT *, MODEL *, double *, double *, 
+			       double *, TIMING *, double *);
+long   optimize_linear_dcd(DOC **, long *, long, long, LEARN_PARM *, 
+			   MODEL *, double *, double *, double *);
 double compute_objective_function(double *, double *, double *, double,
 				  long *, long *);
 void   clear_index(long *);
@@ -47,12 +49,16 @@ long   compute_index(long *,long, long *);
 void   optimize_svm(DOC **, long *, long *, long *, double, long *, long *, 
 		    MODEL *, 
 		    long, long *, long, double *, double *, double *, 
-		    LEARN_PARM *, CFLOAT *, KERNEL_PARM *, QP *, double *);
+		    LEARN_PARM *, CFLOAT *, KERNEL_PARM *, KERNEL_CACHE *,
+		    double *, QP *, QP_SOLVER *, double *, long *);
+void   optimize_pair(long *, double *, double *, double *, LEARN_PARM *,
+		     long *, double *, CFLOAT *);
 void   compute_matrices_for_optimization(DOC **, long *, long *, long *, double,
 					 long *,
 					 long *, long *, MODEL *, double *, 
 					 double *, double *, long, long, LEARN_PARM *, 
-					 CFLOAT *, KERNEL_PARM *, QP *);
+					 CFLOAT *, KERNEL_PARM *, KERNEL_CACHE *,
+					 double *, QP *, long *);
 long   calculate_svm_model(DOC **, long *, long *, double *, double *, 
 			   double *, double *, LEARN_PARM *, long *,
 			   long *, MODEL *);
@@ -81,11 +87,11 @@ long   identify_one_misclassified(double *, long *, long *, long,
 long   incorporate_unlabeled_examples(MODEL *, long *,long *, long *,
 				      double *, double *, long, double *,
 				      long *, long *, long, KERNEL_PARM *,
-				      LEARN_PARM *);
+				      LEARN_PARM *, SOLVER_CONTEXT *);
 void   update_linear_component(DOC **, long *, long *, double *, double *, 
 			       long *, long, long, KERNEL_PARM *, 
 			       KERNEL_CACHE *, double *,
-			       CFLOAT *, double *);
+			       CFLOAT *, SPARSE_ACCU *, long *);
 long   select_next_qp_subproblem_grad(long *, long *, double *, 
 				      double *, double *, long,
 				      long, LEARN_PARM *, long *, long *, 
@@ -96,38 +102,59 @@ long   select_next_qp_subproblem_rand(long *, long *, double *,
 				      long, LEARN_PARM *, long *, long *, 
 				      long *, double *, long *, KERNEL_CACHE *,
 				      long *, long *, long);
+long   select_next_qp_pair(DOC **, long *, double *, double *, double *,
+			   long, LEARN_PARM *, long *, long *, long *,
+			   KERNEL_CACHE *, KERNEL_PARM *, double *, CFLOAT *,
+			   long *, long *);
 long   select_next_qp_slackset(DOC **docs, long int *label, double *a, 
 			       double *lin, double *slack, double *alphaslack, 
 			       double *c, LEARN_PARM *learn_parm, 
 			       long int *active2dnum, double *maxviol);
 void   select_top_n(double *, long, long *, long);
 void   init_shrink_state(SHRINK_STATE *, long, long);
+long   shrink_history_save(SHRINK_STATE *, double *, long, long);
 void   shrink_state_cleanup(SHRINK_STATE *);
+void   shrink_state_reset(SHRINK_STATE *, long);
+void   init_solver_context(SOLVER_CONTEXT *);
+void   solver_context_cleanup(SOLVER_CONTEXT *);
 long   shrink_problem(DOC **, LEARN_PARM *, SHRINK_STATE *, KERNEL_PARM *, 
 		      long *, long *, long, long, long, double *, long *);
 void   reactivate_inactive_examples(long *, long *, double *, SHRINK_STATE *,
 				    double *, double*, long, long, long, LEARN_PARM *, 
 				    long *, DOC **, KERNEL_PARM *,
 				    KERNEL_CACHE *, MODEL *, CFLOAT *, 
-				    double *, double *);
+				    SPARSE_ACCU *, double *, long *);
 
 /* cache kernel evalutations to improve speed */
 KERNEL_CACHE *kernel_cache_init(long, long);
 void   kernel_cache_cleanup(KERNEL_CACHE *);
+void   count_kernel_evals(long *, long);
 void   get_kernel_row(KERNEL_CACHE *,DOC **, long, long, long *, CFLOAT *, 
-		      KERNEL_PARM *);
-void   cache_kernel_row(KERNEL_CACHE *,DOC **, long, KERNEL_PARM *);
+		      KERNEL_PARM *, long *);
+void   get_kernel_block(KERNEL_CACHE *,DOC **, long *, long, long *, long,
+			CFLOAT *, KERNEL_PARM *, long *);
+void   cache_kernel_row(KERNEL_CACHE *,DOC **, long, KERNEL_PARM *, long *);
+CFLOAT kernel_cache_compute_elem(KERNEL_CACHE *,DOC **, long, long,
+				 KERNEL_PARM *, long *);
+double get_kernel_elem(KERNEL_CACHE *,DOC **, long, long, KERNEL_PARM *,
+		       long *);
+double *kernel_cache_diagonal(KERNEL_CACHE *,DOC **, long, KERNEL_PARM *,
+			      long *);
 void   cache_multiple_kernel_rows(KERNEL_CACHE *,DOC **, long *, long, 
-				  KERNEL_PARM *);
+				  KERNEL_PARM *, long *);
 void   kernel_cache_shrink(KERNEL_CACHE *,long, long, long *);
-void   kernel_cache_reset_lru(KERNEL_CACHE *);
+void   kernel_cache_compact(KERNEL_CACHE *,long);
+void   kernel_cache_set_max_elems(KERNEL_CACHE *, long);
 long   kernel_cache_malloc(KERNEL_CACHE *);
 void   kernel_cache_free(KERNEL_CACHE *,long);
 long   kernel_cache_free_lru(KERNEL_CACHE *);
-CFLOAT *kernel_cache_clean_and_malloc(KERNEL_CACHE *,long);
+KFLOAT *kernel_cache_clean_and_malloc(KERNEL_CACHE *,long);
 long   kernel_cache_touch(KERNEL_CACHE *,long);
 long   kernel_cache_check(KERNEL_CACHE *,long);
 long   kernel_cache_space_available(KERNEL_CACHE *);
+void   kernel_cache_lru_unlink(KERNEL_CACHE *, long);
+void   kernel_cache_lru_append(KERNEL_CACHE *, long);
+void   kernel_cache_print_statistic(KERNEL_CACHE *);
 
 void compute_xa_estimates(MODEL *, long *, long *, long, DOC **, 
 			  double *, double *, KERNEL_PARM *, 
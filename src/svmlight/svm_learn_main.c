@@ -44,7 +44,7 @@ void   print_help();
 int main (int argc, char* argv[])
 {  
   DOC **docs;  /* training examples */
-  long totwords,totdoc,i;
+  long totwords,totdoc,runtime_start;
   double *target;
   double *alpha_in=NULL;
   KERNEL_CACHE *kernel_cache;
@@ -57,7 +57,34 @@ int main (int argc, char* argv[])
   read_documents(docfile,&docs,&target,&totwords,&totdoc);
   if(restartfile[0]) alpha_in=read_alphas(restartfile,totdoc);
 
-  if(kernel_parm.kernel_type == LINEAR) { /* don't need the cache */
+  if(kernel_parm.rff_dim) { /* approximate rbf kernel by linear one */
+    if(verbosity>=1) {
+      printf("Mapping examples to %ld random Fourier features...",
+	     kernel_parm.rff_dim); fflush(stdout);
+    }
+    runtime_start=get_runtime();
+    kernel_parm.rff_words=totwords;
+    rff_init(&kernel_parm);
+    rff_map_documents(&kernel_parm,docs,totdoc);
+    totwords=kernel_parm.rff_dim;
+    kernel_parm.kernel_type=LINEAR;
+    if(verbosity>=1) {
+      printf("done (%.2f cpu-seconds)\n",
+	     (get_runtime()-runtime_start)/100.0);
+    }
+  }
+
+  if(kernel_parm.kernel_type == PRECOMPUTED) {
+    gram_open(&kernel_parm);
+    if(kernel_parm.gram_n != totdoc) {
+      printf("\nGram matrix %s has %ld rows, but there are %ld examples!\n",
+	     kernel_parm.gram_file,kernel_parm.gram_n,totdoc);
+      exit(1);
+    }
+  }
+
+  if((kernel_parm.kernel_type == LINEAR)          /* don't need the cache */
+     || (kernel_parm.kernel_type == PRECOMPUTED)) { /* the matrix is the cache */
     kernel_cache=NULL;
   }
   else {
@@ -92,13 +119,15 @@ int main (int argc, char* argv[])
      If you want to free the original data, and only keep the model, you 
      have to make a deep copy of 'model'. */
   /* deep_copy_of_model=copy_model(model); */
+  if(kernel_parm.rff_dim) 
+    model->kernel_parm.kernel_type=RFF;
   write_model(modelfile,model);
 
+  gram_close(&kernel_parm);
+  rff_cleanup(&kernel_parm);
   free(alpha_in);
   free_model(model,0);
-  for(i=0;i<totdoc;i++) 
-    free_example(docs[i],1);
-  free(docs);
+  free_documents(docs,totdoc);
   free(target);
 
   return(0);
@@ -125,9 +154,12 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
   learn_parm->skip_final_opt_check=0;
   learn_parm->svm_maxqpsize=10;
   learn_parm->svm_newvarsinqp=0;
+  learn_parm->svm_smo=0;
+  learn_parm->svm_dcd=0;
   learn_parm->svm_iter_to_shrink=-9999;
   learn_parm->maxiter=100000;
   learn_parm->kernel_cache_size=40;
+  learn_parm->shrink_history_size=40;
   learn_parm->svm_c=0.0;
   learn_parm->eps=0.1;
   learn_parm->transduction_posratio=-1.0;
@@ -145,6 +177,11 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
   kernel_parm->coef_lin=1;
   kernel_parm->coef_const=1;
   strcpy(kernel_parm->custom,"empty");
+  strcpy(kernel_parm->gram_file,"");
+  kernel_parm->gram=NULL;
+  kernel_parm->rff_dim=0;
+  kernel_parm->rff_seed=1;
+  kernel_parm->rff_proj=NULL;
   strcpy(type,"c");
 
   for(i=1;(i<argc) && ((argv[i])[0] == '-');i++) {
@@ -158,9 +195,12 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
       case 'f': i++; learn_parm->skip_final_opt_check=!atol(argv[i]); break;
       case 'q': i++; learn_parm->svm_maxqpsize=atol(argv[i]); break;
       case 'n': i++; learn_parm->svm_newvarsinqp=atol(argv[i]); break;
+      case 'S': i++; learn_parm->svm_smo=atol(argv[i]); break;
+      case 'L': i++; learn_parm->svm_dcd=atol(argv[i]); break;
       case '#': i++; learn_parm->maxiter=atol(argv[i]); break;
       case 'h': i++; learn_parm->svm_iter_to_shrink=atol(argv[i]); break;
       case 'm': i++; learn_parm->kernel_cache_size=atol(argv[i]); break;
+      case 'H': i++; learn_parm->shrink_history_size=atol(argv[i]); break;
       case 'c': i++; learn_parm->svm_c=atof(argv[i]); break;
       case 'w': i++; learn_parm->eps=atof(argv[i]); break;
       case 'p': i++; learn_parm->transduction_posratio=atof(argv[i]); break;
@@ -175,6 +215,9 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
       case 's': i++; kernel_parm->coef_lin=atof(argv[i]); break;
       case 'r': i++; kernel_parm->coef_const=atof(argv[i]); break;
       case 'u': i++; strcpy(kernel_parm->custom,argv[i]); break;
+      case 'G': i++; strcpy(kernel_parm->gram_file,argv[i]); break;
+      case 'F': i++; kernel_parm->rff_dim=atol(argv[i]); break;
+      case 'R': i++; kernel_parm->rff_seed=atol(argv[i]); break;
       case 'l': i++; strcpy(learn_parm->predfile,argv[i]); break;
       case 'a': i++; strcpy(learn_parm->alphafile,argv[i]); break;
       case 'y': i++; strcpy(restartfile,argv[i]); break;
@@ -194,7 +237,7 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
     strcpy (modelfile, argv[i+1]);
   }
   if(learn_parm->svm_iter_to_shrink == -9999) {
-    if(kernel_parm->kernel_type == LINEAR) 
+    if((kernel_parm->kernel_type == LINEAR) || (kernel_parm->rff_dim)) 
       learn_parm->svm_iter_to_shrink=2;
     else
       learn_parm->svm_iter_to_shrink=100;
@@ -221,6 +264,32 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
     print_help();
     exit(0);
   }    
+  if((kernel_parm->kernel_type == PRECOMPUTED) 
+     && (!kernel_parm->gram_file[0])) {
+    printf("\nThe precomputed kernel needs a Gram matrix file (option -G)!\n\n");
+    wait_any_key();
+    print_help();
+    exit(0);
+  }    
+  if((kernel_parm->rff_dim < 0) || (kernel_parm->rff_dim % 2)) {
+    printf("\nThe number of random Fourier features must be even: %ld\n\n",kernel_parm->rff_dim);
+    wait_any_key();
+    print_help();
+    exit(0);
+  }    
+  if((kernel_parm->rff_dim) && (kernel_parm->kernel_type != RBF)) {
+    printf("\nRandom Fourier features approximate the rbf kernel (-t 2) only.\n\n");
+    wait_any_key();
+    print_help();
+    exit(0);
+  }    
+  if((kernel_parm->kernel_type == PRECOMPUTED) 
+     && (learn_parm->type == RANKING)) {
+    printf("\nThe precomputed kernel can not be used for preference ranking.\n\n");
+    wait_any_key();
+    print_help();
+    exit(0);
+  }    
   if((learn_parm->skip_final_opt_check) 
      && (kernel_parm->kernel_type == LINEAR)) {
     printf("\nIt does not make sense to skip the final optimality check for linear kernels.\n\n");
@@ -252,6 +321,12 @@ void read_input_parameters(int argc,char *argv[],char *docfile,char *modelfile,
     print_help();
     exit(0);
   }
+  if(learn_parm->shrink_history_size<0) {
+    printf("\nSize of the shrinking history not in valid range: %ld [0,..]\n",learn_parm->shrink_history_size);
+    wait_any_key();
+    print_help();
+    exit(0);
+  }
   if(learn_parm->svm_c<0) {
     printf("\nThe C parameter must be greater than zero!\n\n");
     wait_any_key();
@@ -328,8 +403,10 @@ void print_help()
   printf("         -i [0,1]    -> remove inconsistent training examples\n");
   printf("                        and retrain (default 0)\n");
   printf("Performance estimation options:\n");
-  printf("         -x [0,1]    -> compute leave-one-out estimates (default 0)\n");
-  printf("                        (see [5])\n");
+  printf("         -x [0,1,2]  -> compute leave-one-out estimates (default 0)\n");
+  printf("                        (see [5]). 2 restarts every held-out run from\n");
+  printf("                        the full solution and spreads the runs over\n");
+  printf("                        OpenMP threads\n");
   printf("         -o ]0..2]   -> value of rho for XiAlpha-estimator and for pruning\n");
   printf("                        leave-one-out computation (default 1.0) (see [2])\n");
   printf("         -k [0..100] -> search depth for extended XiAlpha-estimator \n");
@@ -345,18 +422,33 @@ void print_help()
   printf("                        2: radial basis function exp(-gamma ||a-b||^2)\n");
   printf("                        3: sigmoid tanh(s a*b + c)\n");
   printf("                        4: user defined kernel from kernel.h\n");
+  printf("                        5: precomputed Gram matrix (see svm_gram)\n");
   printf("         -d int      -> parameter d in polynomial kernel\n");
   printf("         -g float    -> parameter gamma in rbf kernel\n");
   printf("         -s float    -> parameter s in sigmoid/poly kernel\n");
   printf("         -r float    -> parameter c in sigmoid/poly kernel\n");
   printf("         -u string   -> parameter of user defined kernel\n");
+  printf("         -G string   -> Gram matrix file for precomputed kernel\n");
+  printf("         -F int      -> approximate the rbf kernel by this even number of\n");
+  printf("                        random Fourier features and train a linear model\n");
+  printf("                        on them, 0 for the exact kernel (default 0)\n");
+  printf("         -R int      -> seed of the random Fourier features (default 1)\n");
   printf("Optimization options (see [1]):\n");
   printf("         -q [2..]    -> maximum size of QP-subproblems (default 10)\n");
   printf("         -n [2..q]   -> number of new variables entering the working set\n");
   printf("                        in each iteration (default n = q). Set n<q to prevent\n");
   printf("                        zig-zagging.\n");
+  printf("         -S [0,1]    -> optimize working sets of two variables analytically\n");
+  printf("                        (SMO) instead of with the QP-solver. -q and -n\n");
+  printf("                        are ignored (default 0)\n");
+  printf("         -L [0,1]    -> train linear classifiers by dual coordinate descent\n");
+  printf("                        on the weight vector. The threshold b is learned\n");
+  printf("                        as a regularized constant feature (default 0)\n");
   printf("         -m [5..]    -> size of cache for kernel evaluations in MB (default 40)\n");
   printf("                        The larger the faster...\n");
+  printf("         -H [0..]    -> memory for the history of alphas kept for shrinking\n");
+  printf("                        with non-linear kernels in MB. Shrinking pauses\n");
+  printf("                        when it is used up (default 40)\n");
   printf("         -e float    -> eps: Allow that error for termination criterion\n");
   printf("                        [y [w*x+b] - 1] >= eps (default 0.001)\n");
   printf("         -y [0,1]    -> restart the optimization from alpha values in file\n");
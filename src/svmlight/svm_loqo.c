@@ -29,18 +29,55 @@ long verbosity;
 # define DEF_PRECISION_LINEAR    1E-8
 # define DEF_PRECISION_NONLINEAR 1E-14
 
+struct qp_solver {           /* state kept between calls of optimize_qp */
+  double *primal,*dual;      /* buffers, allocated at the first call */
+  double init_margin;
+  long   init_iter,precision_violations;
+  double opt_precision;
+};
+
+QP_SOLVER *qp_solver_init();
+void   qp_solver_reset();
+void   qp_solver_cleanup();
 double *optimize_qp();
-double *primal=0,*dual=0;
-double init_margin=0.15;
-long   init_iter=500,precision_violations=0;
-double model_b;
-double opt_precision=DEF_PRECISION_LINEAR;
 
 /* /////////////////////////////////////////////////////////////// */
 
 void *my_malloc();
 
-double *optimize_qp(qp,epsilon_crit,nx,threshold,learn_parm)
+QP_SOLVER *qp_solver_init()
+/* returns a new solver state with the default parameters. Each
+   problem solved at the same time needs its own. */
+{
+  QP_SOLVER *s;
+
+  s=(QP_SOLVER *)my_malloc(sizeof(QP_SOLVER));
+  s->primal=0;
+  s->dual=0;
+  qp_solver_reset(s);
+  return(s);
+}
+
+void qp_solver_reset(s)
+QP_SOLVER *s;
+/* restore the adaptive parameters of the solver to their defaults */
+{
+  s->init_margin=0.15;
+  s->init_iter=500;
+  s->precision_violations=0;
+  s->opt_precision=DEF_PRECISION_LINEAR;
+}
+
+void qp_solver_cleanup(s)
+QP_SOLVER *s;
+{
+  free(s->primal);
+  free(s->dual);
+  free(s);
+}
+
+double *optimize_qp(s,qp,epsilon_crit,nx,threshold,learn_parm)
+QP_SOLVER *s;
 QP *qp;
 double *epsilon_crit;
 long nx; /* Maximum number of variables in QP */
@@ -50,12 +87,12 @@ LEARN_PARM *learn_parm;
 {
   register long i,j,result;
   double margin,obj_before,obj_after;
-  double sigdig,dist,epsilon_loqo;
+  double sigdig,dist,epsilon_loqo,model_b;
   int iter;
  
-  if(!primal) { /* allocate memory at first call */
-    primal=(double *)my_malloc(sizeof(double)*nx*3);
-    dual=(double *)my_malloc(sizeof(double)*(nx*2+1));
+  if(!s->primal) { /* allocate memory at first call */
+    s->primal=(double *)my_malloc(sizeof(double)*nx*3);
+    s->dual=(double *)my_malloc(sizeof(double)*(nx*2+1));
   }
   
   if(verbosity>=4) { /* really verbose */
@@ -90,36 +127,36 @@ LEARN_PARM *learn_parm;
   qp->opt_ce0[0]*=(-1.0);
   /* Run pr_loqo. If a run fails, try again with parameters which lead */
   /* to a slower, but more robust setting. */
-  for(margin=init_margin,iter=init_iter;
+  for(margin=s->init_margin,iter=s->init_iter;
       (margin<=0.9999999) && (result!=OPTIMAL_SOLUTION);) {
-    sigdig=-log10(opt_precision);
+    sigdig=-log10(s->opt_precision);
 
     result=pr_loqo((int)qp->opt_n,(int)qp->opt_m,
 		   (double *)qp->opt_g0,(double *)qp->opt_g,
 		   (double *)qp->opt_ce,(double *)qp->opt_ce0,
 		   (double *)qp->opt_low,(double *)qp->opt_up,
-		   (double *)primal,(double *)dual, 
+		   (double *)s->primal,(double *)s->dual, 
 		   (int)(verbosity-2),
 		   (double)sigdig,(int)iter, 
 		   (double)margin,(double)(qp->opt_up[0])/4.0,(int)0);
 
-    if(isnan(dual[0])) {     /* check for choldc problem */
+    if(isnan(s->dual[0])) {     /* check for choldc problem */
       if(verbosity>=2) {
 	printf("NOTICE: Restarting PR_LOQO with more conservative parameters.\n");
       }
-      if(init_margin<0.80) { /* become more conservative in general */
-	init_margin=(4.0*margin+1.0)/5.0;
+      if(s->init_margin<0.80) { /* become more conservative in general */
+	s->init_margin=(4.0*margin+1.0)/5.0;
       }
       margin=(margin+1.0)/2.0;
-      (opt_precision)*=10.0;   /* reduce precision */
+      (s->opt_precision)*=10.0;   /* reduce precision */
       if(verbosity>=2) {
 	printf("NOTICE: Reducing precision of PR_LOQO.\n");
       }
     }
     else if(result!=OPTIMAL_SOLUTION) {
       iter+=2000; 
-      init_iter+=10;
-      (opt_precision)*=10.0;   /* reduce precision */
+      s->init_iter+=10;
+      (s->opt_precision)*=10.0;   /* reduce precision */
       if(verbosity>=2) {
 	printf("NOTICE: Reducing precision of PR_LOQO due to (%ld).\n",result);
       }      
@@ -127,7 +164,7 @@ LEARN_PARM *learn_parm;
   }
 
   if(qp->opt_m)         /* Thanks to Alex Smola for this hint */
-    model_b=dual[0];
+    model_b=s->dual[0];
   else
     model_b=0;
 
@@ -138,35 +175,35 @@ LEARN_PARM *learn_parm;
     dist=-model_b*qp->opt_ce[i]; 
     dist+=(qp->opt_g0[i]+1.0);
     for(j=0;j<i;j++) {
-      dist+=(primal[j]*qp->opt_g[j*qp->opt_n+i]);
+      dist+=(s->primal[j]*qp->opt_g[j*qp->opt_n+i]);
     }
     for(j=i;j<qp->opt_n;j++) {
-      dist+=(primal[j]*qp->opt_g[i*qp->opt_n+j]);
+      dist+=(s->primal[j]*qp->opt_g[i*qp->opt_n+j]);
     }
-    /*  printf("LOQO: a[%d]=%f, dist=%f, b=%f\n",i,primal[i],dist,dual[0]); */
-    if((primal[i]<(qp->opt_up[i]-epsilon_loqo)) && (dist < (1.0-(*epsilon_crit)))) {
-      epsilon_loqo=(qp->opt_up[i]-primal[i])*2.0;
+    /*  printf("LOQO: a[%d]=%f, dist=%f, b=%f\n",i,s->primal[i],dist,s->dual[0]); */
+    if((s->primal[i]<(qp->opt_up[i]-epsilon_loqo)) && (dist < (1.0-(*epsilon_crit)))) {
+      epsilon_loqo=(qp->opt_up[i]-s->primal[i])*2.0;
     }
-    else if((primal[i]>(0+epsilon_loqo)) && (dist > (1.0+(*epsilon_crit)))) {
-      epsilon_loqo=primal[i]*2.0;
+    else if((s->primal[i]>(0+epsilon_loqo)) && (dist > (1.0+(*epsilon_crit)))) {
+      epsilon_loqo=s->primal[i]*2.0;
     }
   }
 
   for(i=0;i<qp->opt_n;i++) {  /* clip alphas to bounds */
-    if(primal[i]<=(0+epsilon_loqo)) {
-      primal[i]=0;
+    if(s->primal[i]<=(0+epsilon_loqo)) {
+      s->primal[i]=0;
     }
-    else if(primal[i]>=(qp->opt_up[i]-epsilon_loqo)) {
-      primal[i]=qp->opt_up[i];
+    else if(s->primal[i]>=(qp->opt_up[i]-epsilon_loqo)) {
+      s->primal[i]=qp->opt_up[i];
     }
   }
 
   obj_after=0;  /* calculate objective after optimization */
   for(i=0;i<qp->opt_n;i++) {
-    obj_after+=(qp->opt_g0[i]*primal[i]);
-    obj_after+=(0.5*primal[i]*primal[i]*qp->opt_g[i*qp->opt_n+i]);
+    obj_after+=(qp->opt_g0[i]*s->primal[i]);
+    obj_after+=(0.5*s->primal[i]*s->primal[i]*qp->opt_g[i*qp->opt_n+i]);
     for(j=0;j<i;j++) {
-      obj_after+=(primal[j]*primal[i]*qp->opt_g[j*qp->opt_n+i]);
+      obj_after+=(s->primal[j]*s->primal[i]*qp->opt_g[j*qp->opt_n+i]);
     }
   }
 
@@ -174,7 +211,7 @@ LEARN_PARM *learn_parm;
   /* working set. */
   if(isnan(obj_after) || isnan(model_b)) {
     for(i=0;i<qp->opt_n;i++) {
-      primal[i]=qp->opt_xinit[i];
+      s->primal[i]=qp->opt_xinit[i];
     }     
     model_b=0;
     if(learn_parm->svm_maxqpsize>2) {
@@ -183,16 +220,16 @@ LEARN_PARM *learn_parm;
   }
 
   if(obj_after >= obj_before) { /* check whether there was progress */
-    (opt_precision)/=100.0;
-    precision_violations++;
+    (s->opt_precision)/=100.0;
+    s->precision_violations++;
     if(verbosity>=2) {
       printf("NOTICE: Increasing Precision of PR_LOQO.\n");
     }
   }
 
-  if(precision_violations > 500) { 
+  if(s->precision_violations > 500) { 
     (*epsilon_crit)*=10.0;
-    precision_violations=0;
+    s->precision_violations=0;
     if(verbosity>=1) {
       printf("\nWARNING: Relaxing epsilon on KT-Conditions.\n");
     }
@@ -205,7 +242,7 @@ LEARN_PARM *learn_parm;
     return(qp->opt_xinit);
   }
   else {
-    return(primal);
+    return(s->primal);
   }
 }
 
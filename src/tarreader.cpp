@@ -0,0 +1,134 @@
+#include "tarreader.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	const size_t blockSize = 512;
+
+	std::string field (const char *block, size_t offset, size_t length)
+	{
+		const auto begin = block + offset;
+		return std::string (begin, std::find (begin, begin + length, '\0'));
+	}
+
+	size_t parseOctal (const char *block, size_t offset, size_t length)
+	{
+		size_t result = 0;
+		for (auto p = block + offset, end = p + length; p < end && *p; ++p)
+		{
+			if (*p == ' ')
+				continue;
+			if (*p < '0' || *p > '7')
+				throw std::runtime_error ("malformed tar header");
+			result = result * 8 + (*p - '0');
+		}
+		return result;
+	}
+
+	bool isZeroBlock (const char *block)
+	{
+		return std::all_of (block, block + blockSize, [] (char c) { return c == 0; });
+	}
+
+	bool checksumMatches (const char *block)
+	{
+		size_t sum = 0;
+		for (size_t i = 0; i < blockSize; ++i)
+			sum += (i >= 148 && i < 156) ?
+					' ' :
+					static_cast<unsigned char> (block [i]);
+		return sum == parseOctal (block, 148, 8);
+	}
+
+	/* Extracts the path record from a pax extended header, whose records
+	 * are of the form "<len> <key>=<value>\n".
+	 */
+	std::string paxPath (const std::string& data)
+	{
+		size_t pos = 0;
+		while (pos < data.size ())
+		{
+			const auto space = data.find (' ', pos);
+			if (space == std::string::npos)
+				break;
+
+			const auto len = std::stoul (data.substr (pos, space - pos));
+			if (!len || pos + len > data.size ())
+				break;
+
+			const auto record = data.substr (space + 1, pos + len - space - 2);
+			if (record.compare (0, 5, "path=") == 0)
+				return record.substr (5);
+
+			pos += len;
+		}
+		return std::string ();
+	}
+}
+
+TarReader::TarReader (const std::string& path)
+: Stream_ (path, std::ios::binary)
+{
+	if (!Stream_)
+		throw std::runtime_error ("unable to open " + path);
+}
+
+bool TarReader::Next (Entry& entry)
+{
+	char block [blockSize];
+	while (Stream_.read (block, blockSize))
+	{
+		if (isZeroBlock (block))
+			return false;
+
+		if (!checksumMatches (block))
+			throw std::runtime_error ("tar header checksum mismatch");
+
+		const auto size = parseOctal (block, 124, 12);
+		const auto type = block [156];
+
+		std::string name = field (block, 0, 100);
+		const auto prefix = field (block, 345, 155);
+		if (field (block, 257, 5) == "ustar" && !prefix.empty ())
+			name = prefix + "/" + name;
+
+		switch (type)
+		{
+		case 'L':
+			ReadPadded (PendingName_, size);
+			PendingName_ = field (PendingName_.c_str (), 0, PendingName_.size ());
+			continue;
+		case 'x':
+		{
+			std::string pax;
+			ReadPadded (pax, size);
+			PendingName_ = paxPath (pax);
+			continue;
+		}
+		case '0':
+		case '\0':
+		case '7':
+			if (!PendingName_.empty ())
+				name.swap (PendingName_);
+			PendingName_.clear ();
+
+			entry.Name_ = std::move (name);
+			ReadPadded (entry.Data_, size);
+			return true;
+		default:
+			PendingName_.clear ();
+			Stream_.seekg ((size + blockSize - 1) / blockSize * blockSize, std::ios::cur);
+			break;
+		}
+	}
+	return false;
+}
+
+void TarReader::ReadPadded (std::string& data, size_t size)
+{
+	data.resize (size);
+	if (size && !Stream_.read (&data [0], size))
+		throw std::runtime_error ("truncated tar entry");
+	Stream_.ignore ((blockSize - size % blockSize) % blockSize);
+}
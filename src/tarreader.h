@@ -0,0 +1,31 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+/** Sequential reader for uncompressed (ustar, GNU or pax) tar archives.
+ *
+ * Only regular files are reported; directories, links and other special
+ * entries are skipped. Nothing is extracted to the filesystem: each
+ * entry's contents are read into memory as the archive is walked.
+ */
+class TarReader
+{
+	std::ifstream Stream_;
+	std::string PendingName_;
+public:
+	struct Entry
+	{
+		std::string Name_;
+		std::string Data_;
+	};
+
+	TarReader (const std::string& path);
+
+	/** Reads the next regular file entry into entry. Returns false at
+	 * the end of the archive.
+	 */
+	bool Next (Entry& entry);
+private:
+	void ReadPadded (std::string& data, size_t size);
+};
@@ -0,0 +1,74 @@
+#include "../raster.h"
+#include <sstream>
+
+namespace
+{
+	int failures = 0;
+
+	void check (bool cond, const std::string& what)
+	{
+		if (!cond)
+		{
+			std::cerr << "FAILED: " << what << std::endl;
+			++failures;
+		}
+	}
+
+	/* 4x3 images: blank ones, and ones with a single dark pixel at (1, 1).
+	 */
+	std::string blankP4 ()
+	{
+		return std::string ("P4\n4 3\n") + std::string (3, '\0');
+	}
+
+	std::string dotP4 ()
+	{
+		std::string data ("P4\n4 3\n");
+		data += '\0';
+		data += '\x40';
+		data += '\0';
+		return data;
+	}
+
+	std::string blankP5 ()
+	{
+		return std::string ("P5\n4 3\n255\n") + std::string (12, '\xff');
+	}
+
+	std::string dotP5 ()
+	{
+		auto data = blankP5 ();
+		data [data.size () - 12 + 4 + 1] = '\0';
+		return data;
+	}
+
+	bool throwsOnRead (const std::string& data, const std::string& name)
+	{
+		std::istringstream istr (data);
+		try
+		{
+			ReadRasterContour (istr, name);
+		}
+		catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return false;
+	}
+
+	bool readsDot (const std::string& data, const std::string& name)
+	{
+		std::istringstream istr (data);
+		const auto pts = ReadRasterContour (istr, name);
+		return pts.size () == 1 && pts [0] == Point_t (1, 1);
+	}
+}
+
+int main ()
+{
+	check (throwsOnRead (blankP4 (), "blank.pbm"), "blank P4 is rejected");
+	check (throwsOnRead (blankP5 (), "blank.pgm"), "blank P5 is rejected");
+	check (readsDot (dotP4 (), "dot.pbm"), "single pixel P4");
+	check (readsDot (dotP5 (), "dot.pgm"), "single pixel P5");
+	return failures ? 1 : 0;
+}